@@ -0,0 +1,163 @@
+#include "BatchParameterizer.h"
+#include <fstream>
+
+BatchParameterizer::BatchParameterizer()
+{
+}
+
+bool BatchParameterizer::LoadMesh(std::string filename)
+{
+	OpenMesh::IO::Options opt;
+	opt += OpenMesh::IO::Options::VertexTexCoord;
+	if (!OpenMesh::IO::read_mesh(mesh_, filename, opt)) {
+		std::cerr << "Error: cannot read mesh " << filename << std::endl;
+		return false;
+	}
+	NormalizeMesh(mesh_);
+	marker_.SetObject(mesh_);
+	marker_.ResetMarker();
+	return true;
+}
+
+bool BatchParameterizer::LoadMarker(std::string filename)
+{
+	// MeshMarker::LoadFromFile silently skips a missing file, so check it here.
+	std::ifstream f(filename);
+	if (!f.is_open()) {
+		std::cerr << "Error: cannot read marker " << filename << std::endl;
+		return false;
+	}
+	f.close();
+	marker_.LoadFromFile(filename);
+	return true;
+}
+
+bool BatchParameterizer::LoadMarkers(std::vector<std::string> filenames)
+{
+	markers_.clear();
+	for (auto it = filenames.begin(); it != filenames.end(); ++it) {
+		std::ifstream f(*it);
+		if (!f.is_open()) {
+			std::cerr << "Error: cannot read marker " << *it << std::endl;
+			return false;
+		}
+		f.close();
+		MeshMarker marker;
+		marker.SetObject(mesh_);
+		marker.LoadFromFile(*it);
+		markers_.push_back(marker);
+	}
+	return true;
+}
+
+bool BatchParameterizer::ComputeEuclideanBatch(int mode)
+{
+	if (mode < 0 || mode > EUCLIDEAN_CG_TUTTE) {
+		std::cerr << "Error: euclidean mode should be 0 (LU), 1 (Cholesky), 2 (CG) or 3 (CG from Tutte)" << std::endl;
+		return false;
+	}
+	EuclideanOrbifoldBatchSolver solver(mesh_);
+	for (auto it = markers_.begin(); it != markers_.end(); ++it)
+		solver.AddMarker(it->GetSingularityFlag(), it->GetConeAngleFlag(), it->GetSliceFlag());
+	sliced_meshes_ = solver.Compute(mode);
+	timer_ = solver.Timer();
+	for (auto it = sliced_meshes_.begin(); it != sliced_meshes_.end(); ++it) {
+		if (it->n_vertices() == 0) {
+			std::cerr << "Error: solver produced an empty mesh" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BatchParameterizer::SaveMeshes(std::vector<std::string> filenames)
+{
+	OpenMesh::IO::Options opt;
+	opt += OpenMesh::IO::Options::VertexTexCoord;
+	for (int i = 0; i < filenames.size() && i < sliced_meshes_.size(); ++i) {
+		if (!OpenMesh::IO::write_mesh(sliced_meshes_[i], filenames[i], opt)) {
+			std::cerr << "Error: cannot write mesh " << filenames[i] << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BatchParameterizer::Compute(BatchMethod method, int mode)
+{
+	timer_.Reset();
+	if (method == BATCH_EUCLIDEAN) {
+		if (mode < 0 || mode > EUCLIDEAN_CG_TUTTE) {
+			std::cerr << "Error: euclidean mode should be 0 (LU), 1 (Cholesky), 2 (CG) or 3 (CG from Tutte)" << std::endl;
+			return false;
+		}
+		EuclideanOrbifoldSolver solver(mesh_, marker_.GetSingularityFlag(), marker_.GetConeAngleFlag(), marker_.GetSliceFlag());
+		sliced_mesh_ = solver.Compute(mode);
+		timer_ = solver.Timer();
+	}
+	else if (method == BATCH_HYPERBOLIC) {
+		// The solver validates the mode and returns an empty mesh for an invalid one.
+		HyperbolicOrbifoldSolver solver(mesh_, marker_.GetSingularityFlag(), marker_.GetSliceFlag());
+		solver.SetIterationCallback(iteration_callback_);
+		sliced_mesh_ = solver.Compute(mode);
+		timer_ = solver.Timer();
+	}
+	else if (method == BATCH_BFF) {
+		if (mode < 0 || mode > 5) {
+			std::cerr << "Error: BFF mode should be in [0, 5]" << std::endl;
+			return false;
+		}
+		// Only a disk needs no cut, otherwise cut through the cones when the marker has no slices.
+		int euler = mesh_.n_vertices() - mesh_.n_edges() + mesh_.n_faces();
+		if (marker_.NumSlices() == 0 && euler != 1) {
+			marker_.ComputeCutGraph();
+			std::cout << "Automatic cut graph: " << marker_.NumSlices() << " edges" << std::endl;
+		}
+		BFFSolver solver(mesh_, marker_.GetSingularityFlag(), marker_.GetConeAngleFlag(), marker_.GetSliceFlag());
+		sliced_mesh_ = solver.Compute(mode);
+		timer_ = solver.Timer();
+	}
+	else {
+		std::cerr << "Error: unknown method" << std::endl;
+		return false;
+	}
+
+	if (sliced_mesh_.n_vertices() == 0) {
+		std::cerr << "Error: solver produced an empty mesh" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool BatchParameterizer::SaveMesh(std::string filename)
+{
+	OpenMesh::IO::Options opt;
+	opt += OpenMesh::IO::Options::VertexTexCoord;
+	if (!OpenMesh::IO::write_mesh(sliced_mesh_, filename, opt)) {
+		std::cerr << "Error: cannot write mesh " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+BatchMethod BatchParameterizer::ParseMethod(std::string name)
+{
+	if (name == "euclidean")
+		return BATCH_EUCLIDEAN;
+	if (name == "hyperbolic")
+		return BATCH_HYPERBOLIC;
+	if (name == "bff")
+		return BATCH_BFF;
+	return BATCH_UNKNOWN;
+}
+
+std::string BatchParameterizer::MethodName(BatchMethod method)
+{
+	if (method == BATCH_EUCLIDEAN)
+		return "euclidean";
+	if (method == BATCH_HYPERBOLIC)
+		return "hyperbolic";
+	if (method == BATCH_BFF)
+		return "bff";
+	return "unknown";
+}
@@ -0,0 +1,58 @@
+#ifndef BATCH_PARAMETERIZER_H_
+#define BATCH_PARAMETERIZER_H_
+
+#include <iostream>
+#include <string>
+
+#include <MeshDefinition.h>
+#include <MeshMarker.h>
+
+#include <EuclideanOrbifoldSolver.h>
+#include <EuclideanOrbifoldBatchSolver.h>
+#include <HyperbolicOrbifoldSolver.h>
+#include <BFF.h>
+#include <StageTimer.h>
+
+enum BatchMethod { BATCH_EUCLIDEAN, BATCH_HYPERBOLIC, BATCH_BFF, BATCH_UNKNOWN };
+
+// This class runs one parameterization without any window or OpenGL context.
+// It does the same work as the "Core Functions" buttons of the viewer:
+// load a mesh and its marker, run one solver, and save the sliced mesh with uvs.
+class BatchParameterizer {
+public:
+	BatchParameterizer();
+	bool LoadMesh(std::string filename);
+	bool LoadMarker(std::string filename);
+
+	// mode is the mode of BFFSolver::Compute for BFF and a HyperbolicSolverMode for the hyperbolic solver.
+	bool Compute(BatchMethod method, int mode = 0);
+	bool SaveMesh(std::string filename);
+
+	// Several markers of the loaded mesh, embedded together by EuclideanOrbifoldBatchSolver.
+	bool LoadMarkers(std::vector<std::string> filenames);
+	bool ComputeEuclideanBatch(int mode = EUCLIDEAN_CHOLESKY);
+	bool SaveMeshes(std::vector<std::string> filenames);
+
+	SurfaceMesh &Mesh() { return mesh_; }
+	SurfaceMesh &SlicedMesh() { return sliced_mesh_; }
+	std::vector<SurfaceMesh> &SlicedMeshes() { return sliced_meshes_; }
+
+	// Stage timings reported by the solver of the last Compute.
+	StageTimer &Timer() { return timer_; }
+	// Passed to the hyperbolic solver, see HyperbolicOrbifoldSolver::SetIterationCallback.
+	void SetIterationCallback(HyperbolicIterationCallback callback) { iteration_callback_ = callback; }
+
+	static BatchMethod ParseMethod(std::string name);
+	static std::string MethodName(BatchMethod method);
+
+protected:
+	SurfaceMesh mesh_;
+	SurfaceMesh sliced_mesh_;
+	MeshMarker marker_;
+	std::vector<MeshMarker> markers_;
+	std::vector<SurfaceMesh> sliced_meshes_;
+	StageTimer timer_;
+	HyperbolicIterationCallback iteration_callback_;
+};
+
+#endif // !BATCH_PARAMETERIZER_H_
@@ -0,0 +1,59 @@
+#include "BatchParameterizer.h"
+#include <StringParser.h>
+#include <fstream>
+
+// Headless entry point:
+//   Batch <euclidean|hyperbolic|bff> <mesh.obj> <marker.mark> <output.obj> [mode] [iterations.csv]
+// mode follows BFFSolver::Compute for bff and HyperbolicSolverMode for hyperbolic, it defaults to 0.
+// The hyperbolic solver writes one line per iteration to iterations.csv.
+// For euclidean, comma separated lists of markers and outputs embed the mesh under every
+// marker with EuclideanOrbifoldBatchSolver.
+int main(int argc, char ** argv)
+{
+	if (argc < 5) {
+		std::cerr << "Usage: " << argv[0] << " <euclidean|hyperbolic|bff> <mesh.obj> <marker.mark> <output.obj> [mode] [iterations.csv]" << std::endl;
+		return 1;
+	}
+
+	BatchMethod method = BatchParameterizer::ParseMethod(argv[1]);
+	if (method == BATCH_UNKNOWN) {
+		std::cerr << "Error: unknown method " << argv[1] << std::endl;
+		return 1;
+	}
+	int mode = argc > 5 ? atoi(argv[5]) : 0;
+
+	BatchParameterizer parameterizer;
+	std::ofstream log;
+	if (argc > 6) {
+		log.open(argv[6]);
+		if (!log.is_open()) {
+			std::cerr << "Error: cannot write " << argv[6] << std::endl;
+			return 1;
+		}
+		log << "level,iteration,energy,gradient_norm,step,evaluations,seconds\n";
+		parameterizer.SetIterationCallback([&log](const HyperbolicIteration &it) {
+			log << it.level << "," << it.iteration << "," << it.energy << "," << it.gradient_norm << ","
+				<< it.step << "," << it.evaluations << "," << it.seconds << "\n";
+			return true;
+		});
+	}
+	if (!parameterizer.LoadMesh(argv[2])) return 1;
+
+	std::vector<std::string> markers, outputs;
+	Split(",", argv[3], markers);
+	Split(",", argv[4], outputs);
+	if (markers.size() > 1 || outputs.size() > 1) {
+		if (method != BATCH_EUCLIDEAN || markers.size() != outputs.size()) {
+			std::cerr << "Error: marker lists need the euclidean method and one output per marker" << std::endl;
+			return 1;
+		}
+		if (!parameterizer.LoadMarkers(markers)) return 1;
+		if (!parameterizer.ComputeEuclideanBatch(mode)) return 1;
+		if (!parameterizer.SaveMeshes(outputs)) return 1;
+		return 0;
+	}
+	if (!parameterizer.LoadMarker(argv[3])) return 1;
+	if (!parameterizer.Compute(method, mode)) return 1;
+	if (!parameterizer.SaveMesh(argv[4])) return 1;
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include <BatchParameterizer.h>
+#include <StageTimer.h>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+// End-to-end benchmark over the meshes and markers shipped in experiment/:
+//   Benchmark <experiment_dir> <output.json> [repeats]
+// Every run reports the wall time of each solver stage (slicing, angles_weights,
+// laplacian, factorization, solve, boundary_curve, lbfgs, newton) and the total in seconds.
+// Solver logs still go to stdout, progress goes to stderr and results go to the json file.
+
+struct BenchmarkCase {
+	std::string mesh;
+	std::string marker;
+	BatchMethod method;
+	int mode;
+};
+
+std::vector<BenchmarkCase> BenchmarkCases()
+{
+	std::vector<BenchmarkCase> cases;
+	const char *euclidean_markers[] = { "david_orbifold1.mark", "david_orbifold2.mark", "david_orbifold3.mark" };
+	for (int i = 0; i < 3; ++i) {
+		cases.push_back({ "EuclideanOrbifold/david.obj", std::string("EuclideanOrbifold/") + euclidean_markers[i], BATCH_EUCLIDEAN, EUCLIDEAN_LU });
+		cases.push_back({ "EuclideanOrbifold/david.obj", std::string("EuclideanOrbifold/") + euclidean_markers[i], BATCH_EUCLIDEAN, EUCLIDEAN_CHOLESKY });
+		cases.push_back({ "EuclideanOrbifold/david.obj", std::string("EuclideanOrbifold/") + euclidean_markers[i], BATCH_EUCLIDEAN, EUCLIDEAN_CG_TUTTE });
+	}
+
+	cases.push_back({ "HyperbolicOrbifold/bunny_sphere.obj", "HyperbolicOrbifold/bunny_sphere.mark", BATCH_HYPERBOLIC, HYPERBOLIC_LBFGS });
+	cases.push_back({ "HyperbolicOrbifold/bunny_sphere.obj", "HyperbolicOrbifold/bunny_sphere.mark", BATCH_HYPERBOLIC, HYPERBOLIC_NEWTON });
+	cases.push_back({ "HyperbolicOrbifold/bunny_sphere.obj", "HyperbolicOrbifold/bunny_sphere.mark", BATCH_HYPERBOLIC, HYPERBOLIC_LBFGS | HYPERBOLIC_MULTILEVEL });
+	cases.push_back({ "HyperbolicOrbifold/bunny_sphere.obj", "HyperbolicOrbifold/bunny_sphere.mark", BATCH_HYPERBOLIC, HYPERBOLIC_RIEMANNIAN });
+	cases.push_back({ "HyperbolicOrbifold/bunny_sphere.obj", "HyperbolicOrbifold/bunny_sphere.mark", BATCH_HYPERBOLIC, HYPERBOLIC_PRECONDITIONED });
+
+	const char *bff_pairs[][2] = {
+		{ "ConeParameterization/david.obj", "ConeParameterization/david1.mark" },
+		{ "ConeParameterization/david.obj", "ConeParameterization/david2.mark" },
+		{ "ConeParameterization/max.obj", "ConeParameterization/max.mark" },
+		{ "Polygon/bunny_disk.obj", "Polygon/bunny_disk.mark" },
+		{ "Polygon/half_sphere.obj", "Polygon/half_sphere.mark" },
+		{ "BoundaryFree/cube.obj", "BoundaryFree/cube.mark" },
+	};
+	for (int i = 0; i < 6; ++i) {
+		for (int mode = 0; mode < 6; ++mode)
+			cases.push_back({ bff_pairs[i][0], bff_pairs[i][1], BATCH_BFF, mode });
+	}
+	return cases;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <experiment_dir> <output.json> [repeats]" << std::endl;
+		return 1;
+	}
+	std::string root = std::string(argv[1]) + "/";
+	int repeats = argc > 3 ? atoi(argv[3]) : 1;
+
+	std::ofstream json(argv[2]);
+	if (!json.is_open()) {
+		std::cerr << "Error: cannot write " << argv[2] << std::endl;
+		return 1;
+	}
+	json << std::setprecision(6);
+	json << "{\n  \"repeats\": " << repeats << ",\n  \"runs\": [";
+
+	std::vector<BenchmarkCase> cases = BenchmarkCases();
+	bool first = true;
+	for (auto it = cases.begin(); it != cases.end(); ++it) {
+		for (int r = 0; r < repeats; ++r) {
+			std::cerr << "[Benchmark] " << BatchParameterizer::MethodName(it->method) << " " << it->mode << " " << it->marker << std::endl;
+
+			BatchParameterizer parameterizer;
+			bool success = parameterizer.LoadMesh(root + it->mesh) && parameterizer.LoadMarker(root + it->marker);
+			StageTimer total;
+			total.Start("total");
+			success = success && parameterizer.Compute(it->method, it->mode);
+			total.Stop("total");
+
+			json << (first ? "\n" : ",\n");
+			first = false;
+			json << "    {\n";
+			json << "      \"mesh\": \"" << it->mesh << "\",\n";
+			json << "      \"marker\": \"" << it->marker << "\",\n";
+			json << "      \"solver\": \"" << BatchParameterizer::MethodName(it->method) << "\",\n";
+			json << "      \"mode\": " << it->mode << ",\n";
+			json << "      \"repeat\": " << r << ",\n";
+			json << "      \"success\": " << (success ? "true" : "false") << ",\n";
+			json << "      \"vertices\": " << parameterizer.Mesh().n_vertices() << ",\n";
+			json << "      \"faces\": " << parameterizer.Mesh().n_faces() << ",\n";
+			json << "      \"sliced_vertices\": " << parameterizer.SlicedMesh().n_vertices() << ",\n";
+			json << "      \"total\": " << total.Seconds("total") << ",\n";
+			json << "      \"stages\": {";
+			auto timings = parameterizer.Timer().Timings();
+			for (int i = 0; i < timings.size(); ++i) {
+				json << (i == 0 ? " " : ", ") << "\"" << timings[i].first << "\": " << timings[i].second;
+			}
+			json << " }\n    }";
+			json.flush();
+		}
+	}
+	json << "\n  ]\n}\n";
+	json.close();
+	return 0;
+}
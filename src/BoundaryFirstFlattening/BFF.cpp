@@ -1,7 +1,8 @@
 #include "BFF.h"
 
 BFFSolver::BFFSolver(SurfaceMesh & mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag)
-	:mesh_(mesh), cone_flag_(cone_flag), cone_angle_(cone_angle), slice_flag_(slice_flag)
+	:mesh_(mesh), cone_flag_(cone_flag), cone_angle_(cone_angle), slice_flag_(slice_flag),
+	delta_operator_(-1), sliced_prepared_(false), original_prepared_(false)
 {
 
 }
@@ -18,9 +19,10 @@ SurfaceMesh BFFSolver::Compute(int mode)
 	mode 5: BFF cone parameterization with harmonic extension
 	*/
 
+	timer_.Reset();
 	Init();
 
-	ComputeVertexCurvatures(sliced_mesh_);
+	PrepareMesh(sliced_mesh_);
 	
 	if (mode == 2 || mode == 3)
 		FreeBoundary();
@@ -44,57 +46,157 @@ SurfaceMesh BFFSolver::Compute(int mode)
 void BFFSolver::Init()
 {
 	BFFInitializer initializer(mesh_);
+	// The slicer appends to its output, start from an empty mesh on repeated Computes.
+	sliced_mesh_ = SurfaceMesh();
+	timer_.Start("slicing");
 	initializer.Initiate(sliced_mesh_, cone_flag_, cone_angle_, slice_flag_);
+	timer_.Stop("slicing");
 	cone_vts_ = initializer.GetConeVertices();
 	split_to_ = initializer.split_to();
+
+	sliced_prepared_ = false;
+	original_prepared_ = false;
+	delta_operator_ = -1;
+	CheckCutSignature();
 }
 
-double BFFSolver::CosineLaw(double a, double b, double c)
+void BFFSolver::CheckCutSignature()
 {
-	double cs = (a * a + b * b - c * c) / (2 * a * b);
-	if (-1 > cs)
-		return PI;
-	else if (cs > 1)
-		return 0;
-	else
-		return acos(cs);
+	using namespace OpenMesh;
+	std::vector<int> signature;
+	signature.reserve(3 * mesh_.n_faces() + mesh_.n_edges() + 2);
+	signature.push_back(mesh_.n_vertices());
+	signature.push_back(mesh_.n_faces());
+	for (auto fiter = mesh_.faces_begin(); fiter != mesh_.faces_end(); ++fiter) {
+		for (auto fviter = mesh_.fv_iter(*fiter); fviter.is_valid(); ++fviter)
+			signature.push_back((*fviter).idx());
+	}
+	for (auto eiter = mesh_.edges_begin(); eiter != mesh_.edges_end(); ++eiter) {
+		signature.push_back(mesh_.property(slice_flag_, *eiter) ? 1 : 0);
+	}
+	std::vector<double> geometry;
+	geometry.reserve(3 * mesh_.n_vertices());
+	for (auto viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
+		SurfaceMesh::Point p = mesh_.point(*viter);
+		geometry.push_back(p[0]);
+		geometry.push_back(p[1]);
+		geometry.push_back(p[2]);
+	}
+
+	if (signature != cut_signature_) {
+		factorizations_.clear();
+		symmetric_factorizations_.clear();
+		stale_factorizations_.clear();
+		patterns_.clear();
+		cut_signature_.swap(signature);
+	}
+	else if (geometry != geometry_signature_) {
+		// Same sparsity, keep patterns and symbolic factorizations and only refactor.
+		for (auto it = factorizations_.begin(); it != factorizations_.end(); ++it)
+			stale_factorizations_.insert(it->first);
+		for (auto it = symmetric_factorizations_.begin(); it != symmetric_factorizations_.end(); ++it)
+			stale_factorizations_.insert(it->first);
+	}
+	geometry_signature_.swap(geometry);
 }
 
-void BFFSolver::ComputeCornerAngles(SurfaceMesh &mesh, Eigen::VectorXd &L)
+void BFFSolver::PrepareMesh(SurfaceMesh &mesh)
 {
-	using namespace OpenMesh;
-	bool with_length = false;
-	if (L.size() == mesh.n_edges())
-		with_length = true;
-	for (auto fiter = mesh.faces_begin(); fiter != mesh.faces_end(); ++fiter) {
-		FaceHandle f = *fiter;
-		std::vector<HalfedgeHandle> he;
-
-		for (auto fhiter = mesh.fh_iter(f); fhiter.is_valid(); ++fhiter) {
-			he.push_back(*fhiter);
-		}
-		double l[3];
-		if (with_length) {
-			l[0] = L(mesh.edge_handle(he[0]).idx());
-			l[1] = L(mesh.edge_handle(he[1]).idx());
-			l[2] = L(mesh.edge_handle(he[2]).idx());
-		}
-		else {
-			l[0] = mesh.calc_edge_length(mesh.edge_handle(he[0]));
-			l[1] = mesh.calc_edge_length(mesh.edge_handle(he[1]));
-			l[2] = mesh.calc_edge_length(mesh.edge_handle(he[2]));
-		}
-		for (int i = 0; i < 3; ++i) {
-			double cs = CosineLaw(l[i], l[(i + 1) % 3], l[(i + 2) % 3]);
-			mesh.data(he[i]).set_angle(cs);
-		}
+	bool &prepared = (&mesh == &sliced_mesh_) ? sliced_prepared_ : original_prepared_;
+	if (prepared) return;
+	ComputeVertexCurvatures(mesh);
+	ReindexVertices(mesh);
+	prepared = true;
+}
+
+void BFFSolver::AssembleOperator(BFFOperator op)
+{
+	if (op == BFF_INTERIOR_LAPLACIAN)
+		op = BFF_LAPLACIAN;
+	if (delta_operator_ == op) return;
+
+	if (op == BFF_ORIGINAL_LAPLACIAN)
+		ComputeLaplacian(mesh_, true, &patterns_[op]);
+	else if (op == BFF_PINNED_LAPLACIAN)
+		ComputeLaplacian(sliced_mesh_, true, &patterns_[op]);
+	else if (op == BFF_LAPLACIAN)
+		ComputeLaplacian(sliced_mesh_, false, &patterns_[op]);
+	else if (op == BFF_HARMONIC)
+		ComputeHarmonicMatrix();
+	delta_operator_ = op;
+}
+
+BFFSolver::LUSolver &BFFSolver::Factorization(BFFOperator op)
+{
+	auto it = factorizations_.find(op);
+	if (it != factorizations_.end() && !stale_factorizations_.count(op))
+		return *it->second;
+
+	AssembleOperator(op);
+	if (it == factorizations_.end())
+		it = factorizations_.emplace(op, std::unique_ptr<LUSolver>(new LUSolver)).first;
+	LUSolver &solver = *it->second;
+	timer_.Start("factorization");
+	// A stale factorization keeps its column ordering and symbolic analysis.
+	bool analyze = !stale_factorizations_.erase(op);
+	if (op == BFF_INTERIOR_LAPLACIAN) {
+		Eigen::SparseMatrix<double> A_II = Delta_.block(0, 0, n_interior_, n_interior_);
+		if (analyze)
+			solver.analyzePattern(A_II);
+		solver.factorize(A_II);
+	}
+	else {
+		if (analyze)
+			solver.analyzePattern(Delta_);
+		solver.factorize(Delta_);
+	}
+	timer_.Stop("factorization");
+	if (solver.info() != Eigen::Success)
+	{
+		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
+	}
+	return solver;
+}
+
+BFFSolver::LDLTSolver &BFFSolver::SymmetricFactorization(BFFOperator op)
+{
+	auto it = symmetric_factorizations_.find(op);
+	if (it != symmetric_factorizations_.end() && !stale_factorizations_.count(op))
+		return *it->second;
+
+	AssembleOperator(op);
+	if (it == symmetric_factorizations_.end())
+		it = symmetric_factorizations_.emplace(op, std::unique_ptr<LDLTSolver>(new LDLTSolver)).first;
+	LDLTSolver &solver = *it->second;
+	timer_.Start("factorization");
+	if (!stale_factorizations_.erase(op))
+		solver.analyzePattern(Delta_);
+	solver.factorize(Delta_);
+	timer_.Stop("factorization");
+	if (solver.info() != Eigen::Success)
+	{
+		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
 	}
+	return solver;
+}
+
+void BFFSolver::FixGauge(Eigen::VectorXd &u, double total)
+{
+	u.array() += (total - u.sum()) / u.size();
 }
 
-void BFFSolver::ComputeVertexCurvatures(SurfaceMesh &mesh, Eigen::VectorXd &L)
+GeometryCache &BFFSolver::Geometry(SurfaceMesh &mesh)
+{
+	return (&mesh == &sliced_mesh_) ? sliced_geometry_ : original_geometry_;
+}
+
+void BFFSolver::ComputeVertexCurvatures(SurfaceMesh &mesh, const Eigen::VectorXd &L)
 {
 	using namespace OpenMesh;
-	ComputeCornerAngles(mesh, L);
+	timer_.Start("angles_weights");
+	GeometryCache &geometry = Geometry(mesh);
+	geometry.Build(mesh, L);
+	geometry.ComputeAngles();
 	double sum = 0.0;
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
@@ -102,7 +204,7 @@ void BFFSolver::ComputeVertexCurvatures(SurfaceMesh &mesh, Eigen::VectorXd &L)
 		for (auto vihiter = mesh.vih_iter(v); vihiter.is_valid(); ++vihiter) {
 			HalfedgeHandle h = *vihiter;
 			if (mesh.is_boundary(h)) continue;
-			angle_sum += mesh.data(h).angle();
+			angle_sum += geometry.Angle(h);
 		}
 		if(!mesh.is_boundary(v))
 			mesh.data(v).set_curvature(2 * PI - angle_sum);
@@ -110,73 +212,35 @@ void BFFSolver::ComputeVertexCurvatures(SurfaceMesh &mesh, Eigen::VectorXd &L)
 			mesh.data(v).set_curvature(PI - angle_sum);
 		sum += mesh.data(v).curvature();
 	}
+	timer_.Stop("angles_weights");
 	std::cout << "Total Curvature: " << sum/ PI << " pi."<<  std::endl;
 }
 
-void BFFSolver::ComputeLaplacian(SurfaceMesh & mesh, bool mode)
+void BFFSolver::ComputeLaplacian(SurfaceMesh & mesh, bool pinned, LaplacianPattern *pattern)
 {
 	using namespace OpenMesh;
 	using namespace Eigen;
 	
-	ReindexVertices(mesh);
-	ComputeHalfedgeWeights(mesh);
+	PrepareMesh(mesh);
 
-	Delta_.resize(mesh.n_vertices(), mesh.n_vertices());
-	Delta_.setZero();
-	std::vector<Eigen::Triplet<double>> A_coefficients;
+	timer_.Start("laplacian");
+	std::vector<int> index(mesh.n_vertices());
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
-		if (mode && (viter == mesh.vertices_begin())){
-			for (auto viter1 = mesh.vertices_begin(); viter1 != mesh.vertices_end(); ++viter1) {
-				VertexHandle v1 = *viter1;
-				A_coefficients.push_back(Eigen::Triplet<double>(mesh.data(v).reindex(), mesh.data(v1).reindex(), 1.));
-			}
-			continue;
-		}
-		double s_w = 0;
-		for (SurfaceMesh::VertexVertexIter vviter = mesh.vv_iter(v); vviter.is_valid(); ++vviter) {
-			VertexHandle neighbor = *vviter;
-			HalfedgeHandle h = mesh.find_halfedge(v, neighbor);
-			double n_w = mesh.data(h).weight();
-			
-			s_w += n_w;
-			A_coefficients.push_back(Eigen::Triplet<double>(mesh.data(v).reindex(), mesh.data(neighbor).reindex(), -n_w));
-		}
-		A_coefficients.push_back(Eigen::Triplet<double>(mesh.data(v).reindex(), mesh.data(v).reindex(), s_w));
-	}
-	Delta_.setFromTriplets(A_coefficients.begin(), A_coefficients.end());
+		index[v.idx()] = mesh.data(v).reindex();
+	}
+	LaplacianAssembler assembler(mesh, Geometry(mesh).Weights());
+	assembler.SetIndex(index);
+	if (pinned)
+		assembler.Pin(*mesh.vertices_begin());
+	if (pattern)
+		assembler.Assemble(Delta_, *pattern);
+	else
+		assembler.Assemble(Delta_);
+	timer_.Stop("laplacian");
 }
 
 
-void BFFSolver::ComputeHalfedgeWeights(SurfaceMesh &mesh)
-{
-	using namespace OpenMesh;
-	ComputeCornerAngles(mesh);
-	for (auto eiter = mesh.edges_begin(); eiter != mesh.edges_end(); ++eiter) {
-		EdgeHandle e = *eiter;
-		HalfedgeHandle h0 = mesh.halfedge_handle(e, 0);
-		HalfedgeHandle h1 = mesh.halfedge_handle(e, 1);
-		HalfedgeHandle h0_next;
-		if (!mesh.is_boundary(h0))
-			h0_next = mesh.next_halfedge_handle(h0);
-		HalfedgeHandle h1_next;
-		if (!mesh.is_boundary(h1))
-			h1_next = mesh.next_halfedge_handle(h1);
-
-		double weight = 0.;
-
-		if (h0_next.is_valid())
-			weight += 1. / tan(mesh.data(h0_next).angle());
-		if (h1_next.is_valid())
-			weight += 1. / tan(mesh.data(h1_next).angle());
-		weight *= 0.5;
-		//if (weight < 0)
-			//weight = 0.01;
-		mesh.data(h0).set_weight(weight);
-		mesh.data(h1).set_weight(weight);
-	}
-}
-
 void BFFSolver::ReindexVertices(SurfaceMesh & mesh)
 {
 	using namespace OpenMesh;
@@ -210,8 +274,10 @@ void BFFSolver::ReindexVertices(SurfaceMesh & mesh)
 
 
 
-	n_boundary_ = n_boundary;
-	n_interior_ = n_interior;
+	if (&mesh == &sliced_mesh_) {
+		n_boundary_ = n_boundary;
+		n_interior_ = n_interior;
+	}
 }
 
 void BFFSolver::BoundaryTargetKKnown()
@@ -222,7 +288,7 @@ void BFFSolver::BoundaryTargetKKnown()
 	VectorXd target_k(mesh.n_vertices());
 	target_k.setZero();
 
-	ReindexVertices(mesh);
+	PrepareMesh(mesh);
 
 	std::cout << "Singularities' curvature:" << std::endl;
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
@@ -253,7 +319,7 @@ void BFFSolver::FreeBoundary()
 	SurfaceMesh &mesh = sliced_mesh_;
 	
 	VectorXd u(mesh.n_vertices());
-	ReindexVertices(mesh);
+	PrepareMesh(mesh);
 
 	u.setZero();
 
@@ -289,8 +355,7 @@ void BFFSolver::GlobalParameterization()
 	using namespace OpenMesh;
 	// Using Cherrier Formula
 	// Construct Sparse system;
-	ComputeLaplacian(mesh, true);
-	ComputeVertexCurvatures(mesh);
+	PrepareMesh(mesh);
 	Eigen::VectorXd b(mesh.n_vertices());
 	
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
@@ -306,21 +371,21 @@ void BFFSolver::GlobalParameterization()
 		}
 	}
 	
+	// u is only defined up to a constant: pin the first vertex and choose the zero mean solution.
 	b(mesh.data(*mesh.vertices_begin()).reindex()) = 0;
 	
-	SparseLU<SparseMatrix<double>, COLAMDOrdering<int>> solver;
-	solver.compute(Delta_);
-	if (solver.info() != Eigen::Success){
-		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
-	}
+	LDLTSolver &solver = SymmetricFactorization(BFF_ORIGINAL_LAPLACIAN);
+	timer_.Start("solve");
 	Eigen::VectorXd u = solver.solve(b);
+	timer_.Stop("solve");
+	FixGauge(u, 0.);
 
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
 		mesh.data(v).set_u(u(mesh.data(v).reindex()));
 	}
 
-	ReindexVertices(sliced_mesh_);
+	PrepareMesh(sliced_mesh_);
 	u.resize(sliced_mesh_.n_vertices());
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
@@ -357,7 +422,8 @@ Eigen::VectorXd BFFSolver::BoundaryUToTargetK(Eigen::VectorXd & u)
 	
 	SurfaceMesh &mesh = sliced_mesh_;
 
-	ComputeLaplacian(mesh);
+	LUSolver &solver = Factorization(BFF_INTERIOR_LAPLACIAN);
+	AssembleOperator(BFF_LAPLACIAN);
 	VectorXd omega(mesh.n_vertices());
 	VectorXd k(n_boundary_);
 
@@ -367,19 +433,15 @@ Eigen::VectorXd BFFSolver::BoundaryUToTargetK(Eigen::VectorXd & u)
 	}
 
 	k = omega.segment(n_interior_, n_boundary_);
-	SparseLU<SparseMatrix<double>> solver;
-	solver.compute(Delta_.block(0, 0, n_interior_, n_interior_));
-	if (solver.info() != Eigen::Success)
-	{
-		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
-	}
 
 	Eigen::SparseMatrix<double> A_IB = Delta_.block(0, n_interior_, n_interior_, n_boundary_);
 	Eigen::SparseMatrix<double> A_BB = Delta_.block(n_interior_, n_interior_, n_boundary_, n_boundary_);
 	Eigen::SparseMatrix<double> A_BI = Delta_.block(n_interior_, 0, n_boundary_, n_interior_);
 	VectorXd omega_I = omega.segment(0, n_interior_);
 	Eigen::VectorXd to_inverse = omega_I - A_IB * u;
+	timer_.Start("solve");
 	Eigen::VectorXd inverse = solver.solve(to_inverse);
+	timer_.Stop("solve");
 	assert((Delta_.block(0, 0, n_interior_, n_interior_) * inverse - to_inverse).norm() < 1e-7);
 	Eigen::VectorXd h = A_BI * inverse + A_BB * u;
 
@@ -397,7 +459,7 @@ Eigen::VectorXd BFFSolver::BoundaryTargetKToU(Eigen::VectorXd & target_k)
 	using namespace OpenMesh;
 
 	SurfaceMesh &mesh = sliced_mesh_;
-	ComputeLaplacian(mesh, true);
+	LDLTSolver &solver = SymmetricFactorization(BFF_PINNED_LAPLACIAN);
 
 	VectorXd omega(mesh.n_vertices());
 	VectorXd h(mesh.n_vertices());
@@ -417,15 +479,16 @@ Eigen::VectorXd BFFSolver::BoundaryTargetKToU(Eigen::VectorXd & target_k)
 
 	omega(mesh.data(*mesh.vertices_begin()).reindex()) = 0;
 
+	// The first vertex is pinned, its equation is replaced by the gauge sum(u) = rhs(pin).
+	Eigen::VectorXd rhs = omega + h;
+	int pin = mesh.data(*mesh.vertices_begin()).reindex();
+	double total = rhs(pin);
+	rhs(pin) = 0;
 
-	SparseLU<SparseMatrix<double>> solver;
-	solver.compute(Delta_);
-	if (solver.info() != Eigen::Success)
-	{
-		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
-	} 
-
-	Eigen::VectorXd u = solver.solve(omega  + h);
+	timer_.Start("solve");
+	Eigen::VectorXd u = solver.solve(rhs);
+	timer_.Stop("solve");
+	FixGauge(u, total);
 
 	return u.segment(n_interior_, n_boundary_);
 
@@ -437,6 +500,7 @@ void BFFSolver::IntegrateBoundaryCurve()
 	using namespace OpenMesh;
 	using namespace Eigen;
 	SurfaceMesh &mesh = sliced_mesh_;
+	timer_.Start("boundary_curve");
 
 	VPropHandleT<double> cumulative_angle;
 	VPropHandleT<Vec2d> tangent;
@@ -505,15 +569,16 @@ void BFFSolver::IntegrateBoundaryCurve()
 
 	int n_valid_h = valid_halfedges.size();
 	
-	Eigen::MatrixXd N(n_valid_h, n_valid_h);
+	// Diagonal of N.
+	Eigen::VectorXd N(n_valid_h);
 	N.setZero();
 	for (int i = 1; i < n_valid_h; ++i) {
 		HalfedgeHandle h = valid_halfedges[i];
 		int index = mesh.property(reindex, h);
 		int oppo_index = oppo_relation[index];
-		N(i, i) = L_star(index);
+		N(i) = L_star(index);
 		if (oppo_index >= 0) {
-			N(i, i) *= 2;
+			N(i) *= 2;
 		}
 	}
 
@@ -531,23 +596,37 @@ void BFFSolver::IntegrateBoundaryCurve()
 	}
 
 	// Use quadratic programming to get optimal solutions.
-	Eigen::SparseMatrix<double> Q =  (0.5 * N * N).sparseView();
-	Eigen::VectorXd B = - N.diagonal();
-	
-	Eigen::SparseMatrix<double> A_eq(2, Q.rows());
-	A_eq = newT.sparseView();
-	Eigen::VectorXd B_eq(2); B_eq.setZero();
+	// Q = 0.5 * N * N is diagonal, so solve the equality constrained problem directly
+	// and only run the active set method if a bound turns out to be violated.
+	Eigen::VectorXd Q = 0.5 * N.cwiseProduct(N);
+	Eigen::VectorXd B = - N;
+
+	Eigen::VectorXd L_normalized_valid;
+	if (!SolveClosedBoundaryLengths(Q, B, newT, L_normalized_valid)) {
+		std::vector<Eigen::Triplet<double>> Q_coefficients;
+		std::vector<Eigen::Triplet<double>> A_ieq_coefficients;
+		for (int i = 0; i < n_valid_h; ++i) {
+			Q_coefficients.push_back(Eigen::Triplet<double>(i, i, Q(i)));
+			A_ieq_coefficients.push_back(Eigen::Triplet<double>(i, i, -1.));
+		}
+		Eigen::SparseMatrix<double> Q_sparse(n_valid_h, n_valid_h);
+		Q_sparse.setFromTriplets(Q_coefficients.begin(), Q_coefficients.end());
+
+		Eigen::SparseMatrix<double> A_eq(2, n_valid_h);
+		A_eq = newT.sparseView();
+		Eigen::VectorXd B_eq(2); B_eq.setZero();
 
-	Eigen::SparseMatrix<double> A_ieq = (-Eigen::MatrixXd::Identity(Q.rows(), Q.cols())).sparseView();
-	Eigen::VectorXd B_ieq = -Eigen::VectorXd::Constant(A_ieq.rows(), -1e-3);
+		Eigen::SparseMatrix<double> A_ieq(n_valid_h, n_valid_h);
+		A_ieq.setFromTriplets(A_ieq_coefficients.begin(), A_ieq_coefficients.end());
+		Eigen::VectorXd B_ieq = -Eigen::VectorXd::Constant(A_ieq.rows(), -BOUNDARY_LENGTH_LOWER);
 
-	Eigen::VectorXd lx = Eigen::VectorXd::Constant(Q.cols(), -1000);
-	Eigen::VectorXd ux = Eigen::VectorXd::Constant(Q.cols(), 1000);
+		Eigen::VectorXd lx = Eigen::VectorXd::Constant(n_valid_h, -BOUNDARY_LENGTH_BOUND);
+		Eigen::VectorXd ux = Eigen::VectorXd::Constant(n_valid_h, BOUNDARY_LENGTH_BOUND);
 
-	Eigen::VectorXd L_normalized_valid(L_star_valid.size());
-	L_normalized_valid = L_star_valid;
-	igl::active_set_params as;
-	igl::active_set(Q, B, Eigen::VectorXi(), Eigen::VectorXd(), A_eq, B_eq, A_ieq, B_ieq, lx, ux, as, L_normalized_valid);
+		L_normalized_valid = L_star_valid;
+		igl::active_set_params as;
+		igl::active_set(Q_sparse, B, Eigen::VectorXi(), Eigen::VectorXd(), A_eq, B_eq, A_ieq, B_ieq, lx, ux, as, L_normalized_valid);
+	}
 	Eigen::VectorXd L_normalized(L_star.size());
 	
 
@@ -568,7 +647,49 @@ void BFFSolver::IntegrateBoundaryCurve()
 		Vec2d coord = mesh.texcoord2D(v0) + mesh.property(tangent, v0) * L_normalized(i);
 		mesh.set_texcoord2D(v1, coord);
 	}
-	
+	mesh.remove_property(cumulative_angle);
+	mesh.remove_property(tangent);
+	mesh.remove_property(reindex);
+	timer_.Stop("boundary_curve");
+}
+
+bool BFFSolver::SolveClosedBoundaryLengths(const Eigen::VectorXd &Q, const Eigen::VectorXd &B, const Eigen::MatrixXd &T, Eigen::VectorXd &x)
+{
+	using namespace Eigen;
+	// KKT system of min 0.5 x^T diag(Q) x + B^T x s.t. T x = 0.
+	// It has n + 2 unknowns and O(n) non zeros.
+	int n = Q.size();
+	std::vector<Eigen::Triplet<double>> K_coefficients;
+	K_coefficients.reserve(5 * n);
+	for (int i = 0; i < n; ++i) {
+		if (Q(i) != 0)
+			K_coefficients.push_back(Eigen::Triplet<double>(i, i, Q(i)));
+		for (int j = 0; j < T.rows(); ++j) {
+			K_coefficients.push_back(Eigen::Triplet<double>(i, n + j, T(j, i)));
+			K_coefficients.push_back(Eigen::Triplet<double>(n + j, i, T(j, i)));
+		}
+	}
+	SparseMatrix<double> K(n + T.rows(), n + T.rows());
+	K.setFromTriplets(K_coefficients.begin(), K_coefficients.end());
+	VectorXd rhs(n + T.rows());
+	rhs.setZero();
+	rhs.head(n) = -B;
+
+	SparseLU<SparseMatrix<double>> solver;
+	solver.compute(K);
+	if (solver.info() != Eigen::Success)
+		return false;
+	VectorXd s = solver.solve(rhs);
+	if (solver.info() != Eigen::Success)
+		return false;
+	x = s.head(n);
+
+	// Fall back to the active set method if a bound is active.
+	for (int i = 0; i < n; ++i) {
+		if (!(x(i) >= -BOUNDARY_LENGTH_LOWER && x(i) <= BOUNDARY_LENGTH_BOUND))
+			return false;
+	}
+	return true;
 }
 
 void BFFSolver::ExtendToInteriorHilbert()
@@ -576,7 +697,6 @@ void BFFSolver::ExtendToInteriorHilbert()
 	using namespace Eigen;
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	ComputeHarmonicMatrix();
 	
 	Eigen::VectorXd a_boundary(mesh.n_vertices());
 	a_boundary.setZero();
@@ -588,15 +708,11 @@ void BFFSolver::ExtendToInteriorHilbert()
 		a_boundary(v.idx()) = coord[0];
 	}
 
-	SparseLU<SparseMatrix<double>> solver;
-	solver.compute(Delta_);
-	if (solver.info() != Eigen::Success)
-	{
-		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
-	}
-	Eigen::VectorXd a = solver.solve(a_boundary);
+	timer_.Start("solve");
+	Eigen::VectorXd a = Factorization(BFF_HARMONIC).solve(a_boundary);
+	timer_.Stop("solve");
 
-	ComputeLaplacian(mesh);
+	LUSolver &solver = Factorization(BFF_LAPLACIAN);
 	Eigen::VectorXd h(mesh.n_vertices());
 	h.setZero();
 	for (int i = 0; i < boundary.size(); ++i) {
@@ -606,12 +722,9 @@ void BFFSolver::ExtendToInteriorHilbert()
 		h(mesh.data(v).reindex()) = -0.5 * (a(v_next.idx()) - a(v_prev.idx()));
 	}
 
-	solver.compute(Delta_);
-	if (solver.info() != Eigen::Success)
-	{
-		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
-	}
+	timer_.Start("solve");
 	Eigen::VectorXd b = solver.solve(h);
+	timer_.Stop("solve");
 
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle  v = *viter;
@@ -624,7 +737,6 @@ void BFFSolver::ExtendToInteriorHarmonic()
 	using namespace Eigen;
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	ComputeHarmonicMatrix();
 
 	Eigen::MatrixXd uv_boundary(mesh.n_vertices(), 2);
 	uv_boundary.setZero();
@@ -637,13 +749,10 @@ void BFFSolver::ExtendToInteriorHarmonic()
 		uv_boundary(v.idx(), 1) = coord[1];
 	}
 
-	SparseLU<SparseMatrix<double>> solver;
-	solver.compute(Delta_);
-	if (solver.info() != Eigen::Success)
-	{
-		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
-	}
+	LUSolver &solver = Factorization(BFF_HARMONIC);
+	timer_.Start("solve");
 	Eigen::MatrixXd uv = solver.solve(uv_boundary);
+	timer_.Stop("solve");
 
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle  v = *viter;
@@ -657,26 +766,11 @@ void BFFSolver::ComputeHarmonicMatrix()
 	using namespace Eigen;
 	SurfaceMesh &mesh = sliced_mesh_;
 
-	Delta_.resize(mesh.n_vertices(), mesh.n_vertices());
-	Delta_.setZero();
-	std::vector<Eigen::Triplet<double>> A_coefficients;
-	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
-		VertexHandle v = *viter;
-		if (mesh.is_boundary(v)) {
-			A_coefficients.push_back(Eigen::Triplet<double>(v.idx(), v.idx(), 1.));
-			continue;
-		}
-		double s_w = 0;
-		for (SurfaceMesh::VertexVertexIter vviter = mesh.vv_iter(v); vviter.is_valid(); ++vviter) {
-			VertexHandle neighbor = *vviter;
-			HalfedgeHandle h = mesh.find_halfedge(v, neighbor);
-			double n_w = mesh.data(h).weight();
-			s_w += n_w;
-			A_coefficients.push_back(Eigen::Triplet<double>(v.idx(), neighbor.idx(), -n_w));
-		}
-		A_coefficients.push_back(Eigen::Triplet<double>(v.idx(), v.idx(), s_w));
-	}
-	Delta_.setFromTriplets(A_coefficients.begin(), A_coefficients.end());
+	timer_.Start("laplacian");
+	LaplacianAssembler assembler(mesh, sliced_geometry_.Weights());
+	assembler.SetBoundaryRowType(LaplacianAssembler::IDENTITY_ROW);
+	assembler.Assemble(Delta_, patterns_[BFF_HARMONIC]);
+	timer_.Stop("laplacian");
 }
 
 void BFFSolver::NormalizeUV()
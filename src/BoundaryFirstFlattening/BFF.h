@@ -7,24 +7,47 @@
 #include <Eigen/Dense>
 #include <Eigen/IterativeLinearSolvers>
 #include "BFFInitializer.h"
+#include <StageTimer.h>
+#include <LaplacianAssembler.h>
+#include <GeometryCache.h>
 
 #include <igl/active_set.h>
 
+#include <map>
+#include <set>
+#include <memory>
+
 #ifndef PI
 #define PI 3.141592653
 #endif
 
+// Bounds of the boundary lengths in IntegrateBoundaryCurve: -lower <= l <= bound.
+#define BOUNDARY_LENGTH_LOWER 1e-3
+#define BOUNDARY_LENGTH_BOUND 1000
+
 // This class is the implementation of paper Boundary First Flattening.
 // 
 // BFF algorithm parameterize the surface according to boundary data.
 // We need one of two kinds of boundary as input: conformal factors or target geodesic curvature.
 // These two kinds of data can be converted to each other.
 // Known boundary data is determined by user and processed in the initializer for BFF.
+
+// Operators factored by BFF. They only depend on geometry and cut, so their
+// factorizations are kept between Compute calls until one of them changes.
+enum BFFOperator {
+	BFF_ORIGINAL_LAPLACIAN,	// Laplacian of the uncut mesh, first vertex pinned.
+	BFF_PINNED_LAPLACIAN,	// Laplacian of the sliced mesh, first vertex pinned.
+	BFF_LAPLACIAN,			// Laplacian of the sliced mesh.
+	BFF_INTERIOR_LAPLACIAN,	// Interior block of the sliced Laplacian.
+	BFF_HARMONIC			// Sliced Laplacian with Dirichlet boundary rows.
+};
+
 class BFFSolver {
 public:
 	BFFSolver(SurfaceMesh &mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag);
 	SurfaceMesh Compute(int mode = 0);
 	std::vector<OpenMesh::VertexHandle>  ConeVertices() { return cone_vts_; }
+	StageTimer &Timer() { return timer_; }
 
 protected:
 	SurfaceMesh &mesh_;
@@ -40,24 +63,69 @@ protected:
 
 	Eigen::SparseMatrix<double> Delta_;
 
+	// Lengths, angles and weights of the sliced and the original mesh.
+	GeometryCache sliced_geometry_;
+	GeometryCache original_geometry_;
+
+	typedef Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>> LUSolver;
+	typedef Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> LDLTSolver;
+	std::map<int, std::unique_ptr<LUSolver>> factorizations_;
+	std::map<int, std::unique_ptr<LDLTSolver>> symmetric_factorizations_;
+	// Connectivity and cut the cached patterns and factorizations belong to.
+	std::vector<int> cut_signature_;
+	// Vertex positions of the last Compute, factorizations are refactored when they change.
+	std::vector<double> geometry_signature_;
+	std::set<int> stale_factorizations_;
+	// Sparsity pattern of each operator, refilled with new weights.
+	std::map<int, LaplacianPattern> patterns_;
+	// Operator currently assembled in Delta_, -1 if none.
+	int delta_operator_;
+	// Angles, weights and indices are computed once per Compute.
+	bool sliced_prepared_;
+	bool original_prepared_;
+
 	int n_boundary_;
 	int n_interior_;
 	int n_cones_;
 
+	// Wall time of each stage of the last Compute.
+	StageTimer timer_;
+
 protected:
 
 	// Cut the mesh into disk, and set all kinds of data and flags.
 	void Init();
 
-	double CosineLaw(double a, double b, double c);
+	// Drop cached patterns and factorizations if connectivity or cut differ from the last Compute,
+	// and mark factorizations for numeric refactorization if only the geometry differs.
+	void CheckCutSignature();
+
+	// Compute geometry, curvatures and indices of mesh if not done in this Compute.
+	void PrepareMesh(SurfaceMesh &mesh);
+
+	// Assemble the matrix of an operator into Delta_.
+	void AssembleOperator(BFFOperator op);
+
+	// Cached factorization of an operator, factored on first use.
+	LUSolver &Factorization(BFFOperator op);
+
+	// Cached LDLT factorization of a pinned (symmetric positive definite) operator.
+	LDLTSolver &SymmetricFactorization(BFFOperator op);
+
+	// Shift u by a constant s.t. its entries sum to total.
+	void FixGauge(Eigen::VectorXd &u, double total);
+
+	// Geometry cache of the sliced or the original mesh.
+	GeometryCache &Geometry(SurfaceMesh &mesh);
 	
 	// Compute mesh data
-	void ComputeCornerAngles(SurfaceMesh &mesh, Eigen::VectorXd &l = Eigen::VectorXd());
-	void ComputeHalfedgeWeights(SurfaceMesh &mesh);
-	void ComputeVertexCurvatures(SurfaceMesh &mesh, Eigen::VectorXd &l = Eigen::VectorXd());
+	void ComputeVertexCurvatures(SurfaceMesh &mesh, const Eigen::VectorXd &l = Eigen::VectorXd());
 
 	// Compute cotangent Laplacian operator.
-	void ComputeLaplacian(SurfaceMesh &mesh, bool mode = false);
+	// In pinned mode the row and column of the first vertex are replaced by identity,
+	// which removes the constant null space and keeps the matrix sparse and symmetric.
+	// With a pattern, the sparsity is built once and only values are written afterwards.
+	void ComputeLaplacian(SurfaceMesh &mesh, bool pinned = false, LaplacianPattern *pattern = nullptr);
 	
 	// Seperate inner vertices and boundary vertices.
 	void ReindexVertices(SurfaceMesh &mesh);
@@ -81,6 +149,10 @@ protected:
 
 	// Integrate boundary data into a closed loop.
 	void IntegrateBoundaryCurve();
+
+	// Solve the boundary length QP of IntegrateBoundaryCurve without inequality constraints.
+	// Returns false if the solution violates a bound.
+	bool SolveClosedBoundaryLengths(const Eigen::VectorXd &Q, const Eigen::VectorXd &B, const Eigen::MatrixXd &T, Eigen::VectorXd &x);
 	
 	// Given boundary's embedding, we use harmonic map to get one component.
 	// And minimize conformal energy use hilbert transform over the other component.
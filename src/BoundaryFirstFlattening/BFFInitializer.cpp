@@ -42,16 +42,33 @@ void BFFInitializer::CutMesh(SurfaceMesh & sliced_mesh)
 		sliced_mesh.data(h1_to).set_original_opposition(h0_to);
 	}
 
+	split_to_ = slicer.split_to();
+	SetTargetCurvatures(mesh, sliced_mesh, cone_flag_, cone_angle_, split_to_);
+
+	sliced_mesh.RequestBoundary();
+	auto boundary = sliced_mesh.GetBoundaries().front();
+	for (auto it = boundary.begin(); it != boundary.end(); ++it) {
+		HalfedgeHandle h = *it;
+		if (sliced_mesh.data(sliced_mesh.from_vertex_handle(h)).is_singularity()) {
+			cone_vertices_.push_back(sliced_mesh.from_vertex_handle(h));
+		}
+	}
+
+}
+
+void BFFInitializer::SetTargetCurvatures(SurfaceMesh & mesh, SurfaceMesh & sliced_mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> split_to)
+{
+	using namespace OpenMesh;
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle  v = *viter;
 
-		auto verts = slicer.SplitTo(v);
+		auto verts = mesh.property(split_to, v);
 		
 		for (auto it = verts.begin(); it != verts.end(); ++it) {
 			VertexHandle sv = *it;
 			sliced_mesh.data(sv).set_target_curvature(0);
-			if (mesh.property(cone_flag_, v)) {
-				double angle = mesh_.property(cone_angle_, v) / verts.size();
+			if (mesh.property(cone_flag, v)) {
+				double angle = mesh.property(cone_angle, v) / verts.size();
 				sliced_mesh.data(sv).set_singularity(true);
 				if (sliced_mesh.is_boundary(sv))
 					sliced_mesh.data(sv).set_target_curvature(PI - angle);
@@ -61,18 +78,4 @@ void BFFInitializer::CutMesh(SurfaceMesh & sliced_mesh)
 		}
 
 	}
-
-
-	split_to_ = slicer.split_to();
-
-	sliced_mesh.RequestBoundary();
-	auto boundary = sliced_mesh.GetBoundaries().front();
-	for (auto it = boundary.begin(); it != boundary.end(); ++it) {
-		HalfedgeHandle h = *it;
-		if (sliced_mesh.data(sliced_mesh.from_vertex_handle(h)).is_singularity()) {
-			cone_vertices_.push_back(sliced_mesh.from_vertex_handle(h));
-		}
-	}
-
 }
-
@@ -24,6 +24,9 @@ public:
 	void Initiate(SurfaceMesh &sliced_mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag);
 	std::vector<OpenMesh::VertexHandle> GetConeVertices() { return cone_vertices_; }
 	OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> split_to() { return split_to_; }
+
+	// Set singularity flags and target curvatures of sliced vertices according to cone angles.
+	static void SetTargetCurvatures(SurfaceMesh &mesh, SurfaceMesh &sliced_mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> split_to);
 protected:
 	SurfaceMesh &mesh_;
 	std::vector<OpenMesh::VertexHandle> cone_vertices_;
@@ -0,0 +1,130 @@
+#include "BFFSession.h"
+
+BFFSession::BFFSession(SurfaceMesh & mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag)
+	:BFFSolver(mesh, cone_flag, cone_angle, slice_flag), mode_(0), started_(false), own_angles_(false)
+{
+
+}
+
+BFFSession::~BFFSession()
+{
+	if (own_angles_)
+		mesh_.remove_property(session_angle_);
+}
+
+SurfaceMesh BFFSession::Start(int mode)
+{
+	mode_ = mode;
+	started_ = true;
+	return Compute(mode);
+}
+
+SurfaceMesh BFFSession::SetBoundaryU(const Eigen::VectorXd & u)
+{
+	if (!started_ || u.size() != n_boundary_) {
+		std::cerr << "Error: session not started or wrong boundary size" << std::endl;
+		return sliced_mesh_;
+	}
+	timer_.Reset();
+	Eigen::VectorXd u_B = u;
+	Eigen::VectorXd k = BoundaryUToTargetK(u_B);
+	return UpdateBoundary(u, k);
+}
+
+SurfaceMesh BFFSession::SetBoundaryK(const Eigen::VectorXd & k)
+{
+	if (!started_ || k.size() != n_boundary_) {
+		std::cerr << "Error: session not started or wrong boundary size" << std::endl;
+		return sliced_mesh_;
+	}
+	timer_.Reset();
+	Eigen::VectorXd k_B = k;
+	Eigen::VectorXd u = BoundaryTargetKToU(k_B);
+	return UpdateBoundary(u, k);
+}
+
+SurfaceMesh BFFSession::SetConeAngles(const std::vector<double>& angles)
+{
+	using namespace OpenMesh;
+	std::vector<VertexHandle> cones = ConeAnglesOrder();
+	if (!started_ || angles.size() != cones.size()) {
+		std::cerr << "Error: session not started or wrong number of cones" << std::endl;
+		return sliced_mesh_;
+	}
+	if (mode_ == 2 || mode_ == 3) {
+		std::cerr << "Error: cone angles are outputs of the free boundary modes" << std::endl;
+		return sliced_mesh_;
+	}
+	timer_.Reset();
+	if (!own_angles_) {
+		mesh_.add_property(session_angle_);
+		for (auto viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
+			mesh_.property(session_angle_, *viter) = mesh_.property(cone_angle_, *viter);
+		}
+		cone_angle_ = session_angle_;
+		own_angles_ = true;
+	}
+	for (int i = 0; i < cones.size(); ++i) {
+		mesh_.property(cone_angle_, cones[i]) = angles[i];
+	}
+
+	if (mode_ == 4 || mode_ == 5) {
+		GlobalParameterization();
+		IntegrateBoundaryCurve();
+		if (mode_ == 4)
+			ExtendToInteriorHilbert();
+		else
+			ExtendToInteriorHarmonic();
+		NormalizeUV();
+		return sliced_mesh_;
+	}
+
+	BFFInitializer::SetTargetCurvatures(mesh_, sliced_mesh_, cone_flag_, cone_angle_, split_to_);
+	std::vector<VertexHandle> boundary = BoundaryVertices();
+	Eigen::VectorXd k(n_boundary_);
+	for (int i = 0; i < boundary.size(); ++i) {
+		k(i) = sliced_mesh_.data(boundary[i]).target_curvature();
+	}
+	return SetBoundaryK(k);
+}
+
+std::vector<OpenMesh::VertexHandle> BFFSession::BoundaryVertices()
+{
+	using namespace OpenMesh;
+	std::vector<VertexHandle> boundary(n_boundary_);
+	for (auto viter = sliced_mesh_.vertices_begin(); viter != sliced_mesh_.vertices_end(); ++viter) {
+		VertexHandle v = *viter;
+		if (sliced_mesh_.is_boundary(v))
+			boundary[sliced_mesh_.data(v).reindex() - n_interior_] = v;
+	}
+	return boundary;
+}
+
+std::vector<OpenMesh::VertexHandle> BFFSession::ConeAnglesOrder()
+{
+	using namespace OpenMesh;
+	std::vector<VertexHandle> cones;
+	for (auto viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
+		if (mesh_.property(cone_flag_, *viter))
+			cones.push_back(*viter);
+	}
+	return cones;
+}
+
+SurfaceMesh BFFSession::UpdateBoundary(const Eigen::VectorXd & u, const Eigen::VectorXd & k)
+{
+	using namespace OpenMesh;
+	std::vector<VertexHandle> boundary = BoundaryVertices();
+	for (int i = 0; i < boundary.size(); ++i) {
+		sliced_mesh_.data(boundary[i]).set_u(u(i));
+		sliced_mesh_.data(boundary[i]).set_target_curvature(k(i));
+	}
+
+	IntegrateBoundaryCurve();
+	if (mode_ % 2 == 0)
+		ExtendToInteriorHilbert();
+	else
+		ExtendToInteriorHarmonic();
+	NormalizeUV();
+	return sliced_mesh_;
+}
@@ -0,0 +1,53 @@
+#ifndef BFF_SESSION_H_
+#define BFF_SESSION_H_
+
+#include "BFF.h"
+
+// An interactive BFF session.
+//
+// Start() runs a full BFF Compute once. The sliced mesh, the boundary order and
+// the cached factorizations are kept, so that editing boundary data only runs the
+// Dirichlet-to-Neumann conversion, the boundary integration and the extension solves.
+// Boundary vectors are indexed as BoundaryVertices(), cone angles as ConeAnglesOrder().
+class BFFSession : public BFFSolver {
+public:
+	BFFSession(SurfaceMesh &mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag);
+	~BFFSession();
+
+	// Same modes as BFFSolver::Compute. The mode also decides how cone angles
+	// are applied (boundary curvature for 0-1, Cherrier formula for 4-5) and
+	// which extension is used (hilbert for even modes, harmonic for odd ones).
+	SurfaceMesh Start(int mode = 0);
+
+	// Prescribe conformal factors of boundary vertices.
+	SurfaceMesh SetBoundaryU(const Eigen::VectorXd &u);
+
+	// Prescribe target geodesic curvatures of boundary vertices.
+	SurfaceMesh SetBoundaryK(const Eigen::VectorXd &k);
+
+	// Prescribe the target angle sums of cones. The angles are kept in the session,
+	// the cone_angle property of the marker is left untouched.
+	// Fails in the free boundary modes 2 and 3, where cone angles are outputs.
+	SurfaceMesh SetConeAngles(const std::vector<double> &angles);
+
+	// Boundary vertices of the sliced mesh, in the order of boundary vectors.
+	std::vector<OpenMesh::VertexHandle> BoundaryVertices();
+
+	// Cone vertices of the input mesh, in the order of SetConeAngles.
+	std::vector<OpenMesh::VertexHandle> ConeAnglesOrder();
+
+	SurfaceMesh &SlicedMesh() { return sliced_mesh_; }
+
+protected:
+	int mode_;
+	bool started_;
+	// Cone angles of the session, a copy of the marker's made by the first SetConeAngles.
+	OpenMesh::VPropHandleT<double> session_angle_;
+	bool own_angles_;
+
+protected:
+	// Set u and target curvature of the boundary and lay out the uvs.
+	SurfaceMesh UpdateBoundary(const Eigen::VectorXd &u, const Eigen::VectorXd &k);
+};
+
+#endif // !BFF_SESSION_H_
@@ -0,0 +1,63 @@
+#ifndef ENERGY_FIRST_LINE_SEARCH_H_
+#define ENERGY_FIRST_LINE_SEARCH_H_
+
+#include <Eigen/Core>
+#include <LBFGS.h>
+#include <stdexcept>
+
+// Backtracking Armijo line search for LBFGSpp::LBFGSSolver that only evaluates the energy
+// at rejected trial points. The objective provides f.Energy(x) besides f(x, grad),
+// the gradient is computed once at the accepted point.
+// The accepted steps are the same as with LineSearchBacktracking and
+// LBFGS_LINESEARCH_BACKTRACKING_ARMIJO, the Wolfe variants are not supported.
+// After every step f.Iteration(fx, grad, step, evaluations) is called. If it returns false
+// the gradient is cleared, which LBFGSSolver takes as convergence at the current point.
+// If no step is accepted, x, fx and grad are restored to the start point xp and
+// std::runtime_error is thrown, the energy may be infinite at rejected trial points.
+template <typename Scalar>
+class EnergyFirstLineSearch
+{
+private:
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+public:
+	template <typename Foo>
+	static void LineSearch(Foo& f, Scalar& fx, Vector& x, Vector& grad,
+		Scalar& step,
+		const Vector& drt, const Vector& xp,
+		const LBFGSpp::LBFGSParam<Scalar>& param)
+	{
+		const Scalar dec = 0.5;
+		const Scalar fx_init = fx;
+		const Scalar dg_init = grad.dot(drt);
+		const Scalar dg_test = param.ftol * dg_init;
+
+		for (int iter = 0; iter < param.max_linesearch; iter++)
+		{
+			x.noalias() = xp + step * drt;
+			fx = f.Energy(x);
+
+			// Armijo condition is met, evaluate the gradient at the new point.
+			if (fx <= fx_init + step * dg_test) {
+				fx = f(x, grad);
+				if (!f.Iteration(fx, grad, step, iter + 1))
+					grad.setZero();
+				return;
+			}
+
+			if (step < param.min_step) {
+				x = xp;
+				fx = fx_init;
+				throw std::runtime_error("the line search step became smaller than the minimum value allowed");
+			}
+
+			step *= dec;
+		}
+		// grad was only written at accepted points, it is still the gradient at xp.
+		x = xp;
+		fx = fx_init;
+		throw std::runtime_error("the line search reached the maximum number of trials");
+	}
+};
+
+#endif // !ENERGY_FIRST_LINE_SEARCH_H_
@@ -0,0 +1,98 @@
+#include "EuclideanOrbifoldBatchSolver.h"
+#include <map>
+#include <utility>
+
+EuclideanOrbifoldBatchSolver::EuclideanOrbifoldBatchSolver(SurfaceMesh & mesh)
+	:mesh_(mesh)
+{
+
+}
+
+void EuclideanOrbifoldBatchSolver::AddMarker(OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag)
+{
+	Marker marker;
+	marker.cone_flag = cone_flag;
+	marker.cone_angle = cone_angle;
+	marker.slice_flag = slice_flag;
+	markers_.push_back(marker);
+}
+
+std::vector<SurfaceMesh> EuclideanOrbifoldBatchSolver::Compute(int mode)
+{
+	timer_.Reset();
+	std::vector<SurfaceMesh> sliced_meshes(markers_.size());
+	if (mesh_.n_vertices() <= 10) return sliced_meshes;
+
+	auto groups = GroupMarkers();
+	for (auto git = groups.begin(); git != groups.end(); ++git) {
+		const std::vector<int> &group = *git;
+		const Marker &first = markers_[group.front()];
+		EuclideanOrbifoldSolver base(mesh_, first.cone_flag, first.cone_angle, first.slice_flag);
+		timer_.Start("slicing");
+		base.InitOrbifold();
+		timer_.Stop("slicing");
+		timer_.Start("angles_weights");
+		base.ComputeHalfedgeWeights();
+		timer_.Stop("angles_weights");
+
+		std::vector<EuclideanOrbifoldSolver> solvers;
+		solvers.reserve(group.size());
+		for (int i = 0; i < group.size(); ++i) {
+			base.SetConeAngles(markers_[group[i]].cone_angle);
+			solvers.push_back(base);
+		}
+
+		// The cone angles only change the seam rotations, not the sparsity of the system.
+		Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> ordering;
+		bool shared_ordering = mode == EUCLIDEAN_CHOLESKY && solvers.size() > 1;
+		if (shared_ordering) {
+			timer_.Start("ordering");
+			EuclideanOrbifoldSolver &solver = solvers.front();
+			solver.ConstructReducedSystem();
+			Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> inverse;
+			Eigen::AMDOrdering<int> amd;
+			amd(solver.A_, inverse);
+			ordering = inverse.inverse();
+			timer_.Stop("ordering");
+		}
+
+		timer_.Start("solve");
+#ifdef WITH_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int i = 0; i < solvers.size(); ++i)
+			solvers[i].Solve(mode, shared_ordering ? &ordering : nullptr);
+		timer_.Stop("solve");
+
+		for (int i = 0; i < group.size(); ++i)
+			sliced_meshes[group[i]] = std::move(solvers[i].sliced_mesh_);
+	}
+	return sliced_meshes;
+}
+
+std::vector<std::vector<int>> EuclideanOrbifoldBatchSolver::GroupMarkers()
+{
+	using namespace OpenMesh;
+	std::map<std::pair<std::vector<int>, std::vector<int>>, int> group_index;
+	std::vector<std::vector<int>> groups;
+	for (int i = 0; i < markers_.size(); ++i) {
+		std::pair<std::vector<int>, std::vector<int>> key;
+		for (auto eiter = mesh_.edges_begin(); eiter != mesh_.edges_end(); ++eiter) {
+			if (mesh_.property(markers_[i].slice_flag, *eiter))
+				key.first.push_back((*eiter).idx());
+		}
+		for (auto viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
+			if (mesh_.property(markers_[i].cone_flag, *viter))
+				key.second.push_back((*viter).idx());
+		}
+		auto it = group_index.find(key);
+		if (it == group_index.end()) {
+			group_index[key] = groups.size();
+			groups.push_back(std::vector<int>(1, i));
+		}
+		else {
+			groups[it->second].push_back(i);
+		}
+	}
+	return groups;
+}
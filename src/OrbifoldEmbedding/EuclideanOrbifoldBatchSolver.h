@@ -0,0 +1,44 @@
+#ifndef EUCLIDEAN_ORBIFOLD_BATCH_SOLVER_H_
+#define EUCLIDEAN_ORBIFOLD_BATCH_SOLVER_H_
+
+#include <MeshDefinition.h>
+#include "EuclideanOrbifoldSolver.h"
+#include <StageTimer.h>
+#include <vector>
+
+// This class embeds one mesh under several Euclidean orbifold markers.
+// Markers with the same cut and cones only differ by their cone angles, they are solved as
+// a group: the mesh is sliced and the cotangent weights are computed once per group, and in
+// EUCLIDEAN_CHOLESKY mode all reduced systems of a group share one fill reducing ordering.
+// The solves of a group run in parallel.
+class EuclideanOrbifoldBatchSolver {
+public:
+	EuclideanOrbifoldBatchSolver(SurfaceMesh &mesh);
+
+	void AddMarker(OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag);
+	void ClearMarkers() { markers_.clear(); }
+
+	// Sliced mesh with uvs of each marker, in the order they were added.
+	// mode is a EuclideanSolverMode.
+	std::vector<SurfaceMesh> Compute(int mode = EUCLIDEAN_CHOLESKY);
+	StageTimer &Timer() { return timer_; }
+
+protected:
+	struct Marker {
+		OpenMesh::VPropHandleT<bool> cone_flag;
+		OpenMesh::VPropHandleT<double> cone_angle;
+		OpenMesh::EPropHandleT<bool> slice_flag;
+	};
+
+	SurfaceMesh &mesh_;
+	std::vector<Marker> markers_;
+
+	// Wall time of each stage of the last Compute, summed over the groups.
+	StageTimer timer_;
+
+protected:
+	// Indices of the markers with the same cut edges and cones.
+	std::vector<std::vector<int>> GroupMarkers();
+};
+
+#endif // !EUCLIDEAN_ORBIFOLD_BATCH_SOLVER_H_
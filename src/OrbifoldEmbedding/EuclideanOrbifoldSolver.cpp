@@ -7,15 +7,45 @@ EuclideanOrbifoldSolver::EuclideanOrbifoldSolver(SurfaceMesh & mesh, OpenMesh::V
 	
 }
 
-SurfaceMesh EuclideanOrbifoldSolver::Compute()
+SurfaceMesh EuclideanOrbifoldSolver::Compute(int mode)
 {
+	timer_.Reset();
 	if (mesh_.n_vertices() > 10) {
 		InitOrbifold();
+		timer_.Start("angles_weights");
 		ComputeHalfedgeWeights();
+		timer_.Stop("angles_weights");
+		Solve(mode);
+	}
+	return sliced_mesh_;
+}
+
+void EuclideanOrbifoldSolver::Solve(int mode, const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> *ordering)
+{
+	if (mode == EUCLIDEAN_CHOLESKY) {
+		timer_.Start("laplacian");
+		ConstructReducedSystem();
+		timer_.Stop("laplacian");
+		SolveReducedSystem(ordering);
+	}
+	else if (mode == EUCLIDEAN_CG || mode == EUCLIDEAN_CG_TUTTE) {
+		Eigen::VectorXd x;
+		if (mode == EUCLIDEAN_CG_TUTTE)
+			x = TutteGuess();
+		timer_.Start("laplacian");
+		ConstructReducedSystem();
+		timer_.Stop("laplacian");
+		if (x.size() != b_.size())
+			x.setZero(b_.size());
+		SolveReducedSystemCG(x);
+		SetReducedSolution(x);
+	}
+	else {
+		timer_.Start("laplacian");
 		ConstructSparseSystem();
+		timer_.Stop("laplacian");
 		SolveLinearSystem();
 	}
-	return sliced_mesh_;
 }
 
 
@@ -23,9 +53,12 @@ void EuclideanOrbifoldSolver::InitOrbifold()
 {
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	OrbifoldInitializer initializer(mesh_);
+	initializer_ = std::make_shared<OrbifoldInitializer>(mesh_);
+	OrbifoldInitializer &initializer = *initializer_;
+	timer_.Start("slicing");
 	initializer.Initiate(mesh,cone_flag_, cone_angle_, slice_flag_);
-	initializer.ComputeEuclideanTransformations(sliced_mesh_, vtx_transit_);
+	timer_.Stop("slicing");
+	initializer.ComputeEuclideanTransformations(sliced_mesh_, transit_, vertex_segment_);
 	cone_vts_ = initializer.GetConeVertices();
 	segments_vts_ = initializer.GetSegments();
 
@@ -37,66 +70,27 @@ void EuclideanOrbifoldSolver::InitOrbifold()
 	
 }
 
-
-double EuclideanOrbifoldSolver::CosineLaw(double a, double b, double c)
-{
-	double cs = (a * a + b * b - c * c) / (2 * a * b);
-	assert(-1 <= cs && cs <= 1);
-	return acos(cs);
-}
-
-void EuclideanOrbifoldSolver::ComputeCornerAngles()
+void EuclideanOrbifoldSolver::SetConeAngles(OpenMesh::VPropHandleT<double> cone_angle)
 {
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	for (auto fiter = mesh.faces_begin(); fiter != mesh.faces_end(); ++fiter) {
-		FaceHandle f = *fiter;
-		std::vector<HalfedgeHandle> he;
-
-		for (auto fhiter = mesh.fh_iter(f); fhiter.is_valid(); ++fhiter) {
-			he.push_back(*fhiter);
-		}
-		double l[3];
-		l[0] = mesh.calc_edge_length(mesh.edge_handle(he[0]));
-		l[1] = mesh.calc_edge_length(mesh.edge_handle(he[1]));
-		l[2] = mesh.calc_edge_length(mesh.edge_handle(he[2]));
-		for (int i = 0; i < 3; ++i) {
-			double cs = CosineLaw(l[i], l[(i + 1) % 3], l[(i + 2) % 3]);
-			mesh.data(he[i]).set_angle(cs);
-		}
+	cone_angle_ = cone_angle;
+	// A cone on the cut has several copies sharing its angle, as in OrbifoldInitializer::CutMesh.
+	std::vector<int> original_vertex = initializer_->GetOriginalVertices();
+	std::map<int, int> n_copies;
+	for (auto it = cone_vts_.begin(); it != cone_vts_.end(); ++it)
+		++n_copies[original_vertex[(*it).idx()]];
+	for (auto it = cone_vts_.begin(); it != cone_vts_.end(); ++it) {
+		int v = original_vertex[(*it).idx()];
+		mesh.data(*it).set_angle_sum(mesh_.property(cone_angle_, VertexHandle(v)) / n_copies[v]);
 	}
+	initializer_->ComputeEuclideanTransformations(mesh, transit_, vertex_segment_);
 }
 
 void EuclideanOrbifoldSolver::ComputeHalfedgeWeights()
 {
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-
-	ComputeCornerAngles();
-	for (auto eiter = mesh.edges_begin(); eiter != mesh.edges_end(); ++eiter) {
-		EdgeHandle e = *eiter;
-		HalfedgeHandle h0 = mesh.halfedge_handle(e, 0);
-		HalfedgeHandle h1 = mesh.halfedge_handle(e, 1);
-		HalfedgeHandle h0_next;
-		if(!mesh.is_boundary(h0))
-			h0_next = mesh.next_halfedge_handle(h0);
-		HalfedgeHandle h1_next;
-		if(!mesh.is_boundary(h1))
-			h1_next = mesh.next_halfedge_handle(h1);
-		
-		double weight = 0.;
-
-		if (h0_next.is_valid())
-			weight += 1. / tan(mesh.data(h0_next).angle());
-		if (h1_next.is_valid())
-			weight += 1. / tan(mesh.data(h1_next).angle());
-		weight *= 0.5;
-		if (weight < 0)
-			weight = 0.01;
-		mesh.data(h0).set_weight(weight);
-		mesh.data(h1).set_weight(weight);
-	}
-
+	geometry_.Build(sliced_mesh_);
+	geometry_.ClampNegativeWeights(0.01);
 }
 
 void EuclideanOrbifoldSolver::ConstructSparseSystem()
@@ -111,31 +105,23 @@ void EuclideanOrbifoldSolver::ConstructSparseSystem()
 	std::vector<Eigen::Triplet<double> > A_coefficients;
 
 	// interior vertex satisfies normal harmonic condition
+	// cones are fixed, boundary rows are filled below.
+	LaplacianAssembler assembler(mesh, geometry_.Weights(), 2);
+	assembler.SetBoundaryRowType(LaplacianAssembler::EMPTY_ROW);
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
 		if (mesh.data(v).is_singularity()) {
 			auto uv = mesh.texcoord2D(v);
 			b_(2 * v.idx()) = uv[0];
 			b_(2 * v.idx() + 1) = uv[1];
-			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * v.idx(), 1.));
-			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * v.idx() + 1, 1.));
+			assembler.SetRowType(v, LaplacianAssembler::IDENTITY_ROW);
 		}
 		else if (!mesh.is_boundary(v)) {
 			b_(2 * v.idx()) = 0;
 			b_(2 * v.idx() + 1) = 0;
-			double s_w = 0;
-			for (SurfaceMesh::VertexOHalfedgeIter vohiter = mesh.voh_iter(v); vohiter.is_valid(); ++vohiter) {
-				HalfedgeHandle h = *vohiter;
-				VertexHandle neighbor = mesh.to_vertex_handle(h);
-				double n_w = mesh.data(h).weight();
-				s_w += n_w;
-				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * neighbor.idx(), -n_w));
-				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * neighbor.idx() + 1, -n_w));
-			}
-			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * v.idx(), s_w));
-			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * v.idx() + 1, s_w));
 		}
 	}
+	assembler.AppendTriplets(A_coefficients);
 
 
 	// handle boundary vts;
@@ -146,10 +132,10 @@ void EuclideanOrbifoldSolver::ConstructSparseSystem()
 			b_(2 * v.idx()) = 0;
 			b_(2 * v.idx() + 1) = 0;
 			double s_w = 0.;
-			for (auto vviter = mesh.vv_iter(v); vviter.is_valid(); ++vviter) {
-				VertexHandle neighbor = *vviter;
-				HalfedgeHandle h = mesh.find_halfedge(v, neighbor);
-				double n_w = mesh.data(h).weight();
+			for (auto vohiter = mesh.voh_iter(v); vohiter.is_valid(); ++vohiter) {
+				HalfedgeHandle h = *vohiter;
+				VertexHandle neighbor = mesh.to_vertex_handle(h);
+				double n_w = geometry_.Weight(h);
 				s_w += n_w;
 				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * neighbor.idx(), -n_w));
 				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * neighbor.idx() + 1, -n_w));
@@ -161,13 +147,13 @@ void EuclideanOrbifoldSolver::ConstructSparseSystem()
 			auto equiv = mesh.data(v).equivalent_vertex();
 			Matrix2d coeff_equiv;
 			coeff_equiv.setZero();
-			Matrix3d T = mesh.property(vtx_transit_, equiv); // from equiv to v
-			Matrix2d rotation_matrix = T.block(0,0,2,2);
+			const RigidTransformation &T = transit_[vertex_segment_[equiv.idx()]]; // from equiv to v
+			Matrix2d rotation_matrix = T.RotationMatrix();
 			//std::cout << rotation_matrix << std::endl;
-			for (auto vviter = mesh.vv_iter(equiv); vviter.is_valid(); ++vviter) {
-				VertexHandle neighbor = *vviter;
-				HalfedgeHandle h = mesh.find_halfedge(equiv, neighbor);
-				double n_w = mesh.data(h).weight();
+			for (auto vohiter = mesh.voh_iter(equiv); vohiter.is_valid(); ++vohiter) {
+				HalfedgeHandle h = *vohiter;
+				VertexHandle neighbor = mesh.to_vertex_handle(h);
+				double n_w = geometry_.Weight(h);
 				auto coeff_equiv_neighbor = n_w * rotation_matrix;
 				coeff_equiv += coeff_equiv_neighbor;
 				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * neighbor.idx(), -coeff_equiv_neighbor(0,0)));
@@ -181,7 +167,7 @@ void EuclideanOrbifoldSolver::ConstructSparseSystem()
 			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * equiv.idx() + 1, coeff_equiv(1, 1)));
 
 			
-			b_.segment(2 * equiv.idx(), 2) = - T.block(0,2, 2, 1);
+			b_.segment(2 * equiv.idx(), 2) = - T.Translation();
 					
 			A_coefficients.push_back(Eigen::Triplet<double>(2 * equiv.idx(), 2 * equiv.idx(), rotation_matrix(0,0)));
 			A_coefficients.push_back(Eigen::Triplet<double>(2 * equiv.idx(), 2 * equiv.idx() + 1, rotation_matrix(0, 1)));
@@ -205,12 +191,16 @@ void EuclideanOrbifoldSolver::SolveLinearSystem()
 
 	//Eigen::SparseQR<Eigen::SparseMatrix<double>, COLAMDOrdering<int>> solver;
 	Eigen::SparseLU<Eigen::SparseMatrix<double>> solver;
+	timer_.Start("factorization");
 	solver.compute(A_);
+	timer_.Stop("factorization");
 	if (solver.info() != Eigen::Success)
 	{
 		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
 	}
+	timer_.Start("solve");
 	Eigen::VectorXd x = solver.solve(b_);
+	timer_.Stop("solve");
 	std::cout << "Error:" << (A_ * x - b_).norm() << std::endl;
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
@@ -230,3 +220,175 @@ void EuclideanOrbifoldSolver::SolveLinearSystem()
 	}
 	std::cout << C.transpose() << std::endl;*/
 }
+
+void EuclideanOrbifoldSolver::ConstructReducedSystem(bool uniform)
+{
+	using namespace OpenMesh;
+	using namespace Eigen;
+	SurfaceMesh &mesh = sliced_mesh_;
+	int n_vertices = mesh.n_vertices();
+
+	vertex_master_.resize(n_vertices);
+	for (int i = 0; i < n_vertices; ++i)
+		vertex_master_[i] = i;
+	for (int i = 0; i < segments_vts_.size() / 2; ++i) {
+		for (auto it = segments_vts_[i].begin(); it != segments_vts_[i].end(); ++it) {
+			VertexHandle v = *it;
+			if (mesh.data(v).is_singularity()) continue;
+			vertex_master_[v.idx()] = mesh.data(v).equivalent_vertex().idx();
+		}
+	}
+	vertex_variable_.assign(n_vertices, -1);
+	variable_vertex_.clear();
+	for (int i = 0; i < n_vertices; ++i) {
+		if (mesh.data(VertexHandle(i)).is_singularity() || vertex_master_[i] != i) continue;
+		vertex_variable_[i] = variable_vertex_.size();
+		variable_vertex_.push_back(i);
+	}
+	for (int i = 0; i < n_vertices; ++i)
+		vertex_variable_[i] = vertex_variable_[vertex_master_[i]];
+
+	// Every vertex is x = J y + c for the variables y of its master: J = I, c = 0 for a variable
+	// vertex, J = 0, c = uv for a cone, the rotation and translation of the isometry for a copy.
+	std::vector<Matrix2d> J(n_vertices);
+	std::vector<Vector2d> c(n_vertices);
+	for (int i = 0; i < n_vertices; ++i) {
+		VertexHandle v(i);
+		if (mesh.data(v).is_singularity()) {
+			Vec2d uv = mesh.texcoord2D(v);
+			J[i].setZero();
+			c[i] = Vector2d(uv[0], uv[1]);
+		}
+		else if (vertex_master_[i] != i) {
+			const RigidTransformation &T = transit_[vertex_segment_[vertex_master_[i]]];
+			J[i] = T.RotationMatrix();
+			c[i] = T.Translation();
+		}
+		else {
+			J[i].setIdentity();
+			c[i].setZero();
+		}
+	}
+
+	// Gradient of sum w |x_a - x_b|^2 over the edges w.r.t. the variables.
+	int n = 2 * variable_vertex_.size();
+	std::vector<Triplet<double>> triplets;
+	triplets.reserve(16 * mesh.n_edges());
+	b_.setZero(n);
+	for (int e = 0; e < mesh.n_edges(); ++e) {
+		HalfedgeHandle h = mesh.halfedge_handle(EdgeHandle(e), 0);
+		int end[2] = { mesh.from_vertex_handle(h).idx(), mesh.to_vertex_handle(h).idx() };
+		double w = uniform ? 1. : geometry_.Weight(h);
+		Vector2d c_diff = c[end[0]] - c[end[1]];
+		for (int s = 0; s < 2; ++s) {
+			int var_s = vertex_variable_[end[s]];
+			if (var_s < 0) continue;
+			double sign_s = s == 0 ? 1. : -1.;
+			b_.segment<2>(2 * var_s) -= sign_s * w * J[end[s]].transpose() * c_diff;
+			for (int t = 0; t < 2; ++t) {
+				int var_t = vertex_variable_[end[t]];
+				if (var_t < 0) continue;
+				double sign_t = t == 0 ? 1. : -1.;
+				Matrix2d block = sign_s * sign_t * w * J[end[s]].transpose() * J[end[t]];
+				// Away from the cut the blocks are diagonal, keep u and v uncoupled in the pattern.
+				for (int r = 0; r < 2; ++r) {
+					for (int k = 0; k < 2; ++k) {
+						if (block(r, k) != 0.)
+							triplets.push_back(Triplet<double>(2 * var_s + r, 2 * var_t + k, block(r, k)));
+					}
+				}
+			}
+		}
+	}
+	A_.resize(n, n);
+	A_.setFromTriplets(triplets.begin(), triplets.end());
+}
+
+void EuclideanOrbifoldSolver::SolveReducedSystem(const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> *ordering)
+{
+	Eigen::VectorXd x;
+	if (ordering) {
+		// Permute the system here, so that the factorization keeps the given ordering.
+		Eigen::SimplicialLLT<Eigen::SparseMatrix<double>, Eigen::Lower, Eigen::NaturalOrdering<int>> solver;
+		timer_.Start("factorization");
+		Eigen::SparseMatrix<double> A;
+		A = A_.selfadjointView<Eigen::Lower>().twistedBy(*ordering);
+		solver.compute(A);
+		timer_.Stop("factorization");
+		if (solver.info() != Eigen::Success)
+		{
+			std::cerr << "Waring: Eigen decomposition failed" << std::endl;
+		}
+		timer_.Start("solve");
+		x = ordering->inverse() * solver.solve(*ordering * b_);
+		timer_.Stop("solve");
+	}
+	else {
+		Eigen::SimplicialLLT<Eigen::SparseMatrix<double>> solver;
+		timer_.Start("factorization");
+		solver.compute(A_);
+		timer_.Stop("factorization");
+		if (solver.info() != Eigen::Success)
+		{
+			std::cerr << "Waring: Eigen decomposition failed" << std::endl;
+		}
+		timer_.Start("solve");
+		x = solver.solve(b_);
+		timer_.Stop("solve");
+	}
+	std::cout << "Error:" << (A_ * x - b_).norm() << std::endl;
+	SetReducedSolution(x);
+}
+
+void EuclideanOrbifoldSolver::SolveReducedSystemCG(Eigen::VectorXd & x)
+{
+	Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower | Eigen::Upper, Eigen::IncompleteCholesky<double>> solver;
+	solver.setTolerance(cg_tolerance_);
+	solver.setMaxIterations(cg_max_iterations_);
+	timer_.Start("factorization");
+	solver.compute(A_);
+	timer_.Stop("factorization");
+	if (solver.info() != Eigen::Success)
+	{
+		std::cerr << "Waring: incomplete Cholesky failed" << std::endl;
+	}
+	timer_.Start("solve");
+	x = solver.solveWithGuess(b_, x);
+	timer_.Stop("solve");
+	cg_iterations_ = solver.iterations();
+	cg_residual_ = solver.error();
+	if (solver.info() != Eigen::Success)
+	{
+		std::cerr << "Waring: CG did not converge in " << cg_iterations_ << " iterations" << std::endl;
+	}
+	std::cout << "CG iterations:" << cg_iterations_ << " relative error:" << cg_residual_ << std::endl;
+	std::cout << "Error:" << (A_ * x - b_).norm() << std::endl;
+}
+
+Eigen::VectorXd EuclideanOrbifoldSolver::TutteGuess()
+{
+	timer_.Start("tutte");
+	ConstructReducedSystem(true);
+	Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower | Eigen::Upper> solver;
+	solver.setTolerance(1e-3);
+	solver.setMaxIterations(cg_max_iterations_);
+	solver.compute(A_);
+	Eigen::VectorXd x = solver.solve(b_);
+	timer_.Stop("tutte");
+	return x;
+}
+
+void EuclideanOrbifoldSolver::SetReducedSolution(const Eigen::VectorXd & x)
+{
+	using namespace OpenMesh;
+	SurfaceMesh &mesh = sliced_mesh_;
+	for (int i = 0; i < mesh.n_vertices(); ++i) {
+		VertexHandle v(i);
+		int var = vertex_variable_[i];
+		if (var < 0) continue;
+		Complex uv(x(2 * var), x(2 * var + 1));
+		if (vertex_master_[i] != i)
+			uv = transit_[vertex_segment_[vertex_master_[i]]](uv);
+		mesh.set_texcoord2D(v, Vec2d(uv.real(), uv.imag()));
+	}
+}
@@ -6,21 +6,43 @@
 #include <Eigen/Core>
 #include <Eigen/Sparse>
 #include <Eigen/Dense>
+#include <StageTimer.h>
+#include <LaplacianAssembler.h>
+#include <GeometryCache.h>
+#include <memory>
 
 #ifndef PI
 #define PI 3.141592653
 #endif
 
+// EUCLIDEAN_LU solves the full 2n x 2n system with SparseLU. EUCLIDEAN_CHOLESKY eliminates
+// cones and the copies set by the segment isometries, and minimizes the Dirichlet energy of
+// the remaining vertices: a symmetric positive definite system solved by sparse Cholesky.
+// EUCLIDEAN_CG solves the same system by conjugate gradients with an incomplete Cholesky
+// preconditioner, which needs far less memory than a factorization on very large meshes.
+// EUCLIDEAN_CG_TUTTE starts them from a loose solve of the uniform weight (Tutte) system.
+enum EuclideanSolverMode { EUCLIDEAN_LU = 0, EUCLIDEAN_CHOLESKY = 1, EUCLIDEAN_CG = 2, EUCLIDEAN_CG_TUTTE = 3 };
+
 
 // This class is the implementation of paper: Orbifold Tutte Embeddings.
 // The system is harmonic system plus rotation constraints.
 // So the problem is linear.
 class EuclideanOrbifoldSolver
 {
+	friend class EuclideanOrbifoldBatchSolver;
 public:
 	EuclideanOrbifoldSolver(SurfaceMesh &mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag);
-	SurfaceMesh Compute();
+	// mode is a EuclideanSolverMode.
+	SurfaceMesh Compute(int mode = EUCLIDEAN_LU);
 	std::vector<OpenMesh::VertexHandle> ConeVertices() { return cone_vts_; }
+	StageTimer &Timer() { return timer_; }
+
+	// Relative residual and iteration cap of the conjugate gradient modes.
+	void SetTolerance(double tolerance) { cg_tolerance_ = tolerance; }
+	void SetMaxIterations(int iterations) { cg_max_iterations_ = iterations; }
+	// Iterations and relative residual of the last conjugate gradient solve.
+	int Iterations() const { return cg_iterations_; }
+	double Residual() const { return cg_residual_; }
 protected:
 	SurfaceMesh &mesh_;
 	SurfaceMesh sliced_mesh_;
@@ -29,13 +51,35 @@ protected:
 	OpenMesh::VPropHandleT<double> cone_angle_;
 	OpenMesh::EPropHandleT<bool> slice_flag_;
 
+	// Kept to recompute the isometries when only the cone angles change.
+	std::shared_ptr<OrbifoldInitializer> initializer_;
 	std::vector<OpenMesh::VertexHandle> cone_vts_;
 	std::vector<std::vector<OpenMesh::VertexHandle>> segments_vts_;
-	OpenMesh::VPropHandleT<Eigen::Matrix3d> vtx_transit_;
+	// Isometry of each boundary segment and the segment of each vertex.
+	std::vector<RigidTransformation> transit_;
+	std::vector<int> vertex_segment_;
 	OpenMesh::VPropHandleT<OpenMesh::VertexHandle> vtx_rotation_center_;
 	Eigen::SparseMatrix<double> A_;
 	Eigen::VectorXd b_;
 	Eigen::VectorXd X_;
+
+	// Variables of the reduced system, two per variable vertex. Cones are fixed (-1).
+	// A copy in the first half of the segments follows its equivalent vertex (its master)
+	// through the segment isometry and shares its variable.
+	std::vector<int> vertex_variable_;
+	std::vector<int> vertex_master_;
+	std::vector<int> variable_vertex_;
+
+	// Lengths, angles and cotangent weights of the sliced mesh.
+	GeometryCache geometry_;
+
+	double cg_tolerance_ = 1e-10;
+	int cg_max_iterations_ = 10000;
+	int cg_iterations_ = 0;
+	double cg_residual_ = 0;
+
+	// Wall time of each stage of the last Compute.
+	StageTimer timer_;
 	
 
 protected:
@@ -43,12 +87,27 @@ protected:
 	void InitOrbifold();
 
 
-	double CosineLaw(double a, double b, double c);
-	void ComputeCornerAngles();
+	// Build geometry_, negative cotangent weights are replaced by 0.01.
 	void ComputeHalfedgeWeights();
 
+	// Assemble and solve the system of mode after InitOrbifold and ComputeHalfedgeWeights.
+	// ordering is a fill reducing ordering of the reduced system for the Cholesky mode.
+	void Solve(int mode, const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> *ordering = nullptr);
+	// Same cut and cones, other cone angles: reset the cone coordinates and the isometries.
+	void SetConeAngles(OpenMesh::VPropHandleT<double> cone_angle);
+
 	void ConstructSparseSystem();
 	void SolveLinearSystem();
+
+	// Reduced system of the Cholesky and CG modes in A_, b_, with unit weights if uniform.
+	void ConstructReducedSystem(bool uniform = false);
+	void SolveReducedSystem(const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> *ordering = nullptr);
+	// x holds the initial guess.
+	void SolveReducedSystemCG(Eigen::VectorXd &x);
+	// Loose solve of the uniform weight system, the initial guess of EUCLIDEAN_CG_TUTTE.
+	Eigen::VectorXd TutteGuess();
+	// Coordinates of all vertices from the variables.
+	void SetReducedSolution(const Eigen::VectorXd &x);
 	
 	
 
@@ -1,6 +1,8 @@
 #include "HyperbolicOrbifoldSolver.h"
+#include <algorithm>
 
-
+// Edges per call of the batch distance kernels, their arrays stay in the cache.
+#define EDGE_BLOCK 1024
 
 HyperbolicOrbifoldSolver::HyperbolicOrbifoldSolver(SurfaceMesh &mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::EPropHandleT<bool> slice_flag)
 	: mesh_(mesh), cone_flag_(cone_flag), slice_flag_(slice_flag)
@@ -8,42 +10,308 @@ HyperbolicOrbifoldSolver::HyperbolicOrbifoldSolver(SurfaceMesh &mesh, OpenMesh::
 
 }
 
-SurfaceMesh HyperbolicOrbifoldSolver::Compute()
+SurfaceMesh HyperbolicOrbifoldSolver::Compute(int mode)
+{
+	int minimizer = mode & (HYPERBOLIC_NEWTON | HYPERBOLIC_RIEMANNIAN | HYPERBOLIC_PRECONDITIONED);
+	if (mode < 0 || mode > (HYPERBOLIC_MULTILEVEL | HYPERBOLIC_PRECONDITIONED) || (minimizer & (minimizer - 1))) {
+		std::cerr << "Error: hyperbolic mode should be 0 (LBFGS), 1 (Newton), 4 (Riemannian), 8 (preconditioned LBFGS), plus 2 for multilevel" << std::endl;
+		return SurfaceMesh();
+	}
+	timer_.Reset();
+	start_time_ = std::chrono::steady_clock::now();
+	level_ = 0;
+	if (mesh_.n_vertices() > 10) {
+		HyperbolicSolutionKey key;
+		if (solution_cache_) {
+			key = HyperbolicSolutionCache::Key(mesh_, cone_flag_, slice_flag_, mode);
+			const HyperbolicSolution *solution = solution_cache_->Find(key);
+			if (solution) {
+				std::cout << "Cached solution reused" << std::endl;
+				sliced_mesh_ = solution->sliced_mesh;
+				cone_vts_ = solution->cone_vts;
+				return sliced_mesh_;
+			}
+		}
+		InitOrbifold();
+		if (WarmStart(key)) {
+			Minimize(mode, max_error);
+		}
+		else if (mode & HYPERBOLIC_MULTILEVEL) {
+			SolveMultilevel(mode);
+		}
+		else {
+			timer_.Start("angles_weights");
+			ComputeHalfedgeWeights();
+			timer_.Stop("angles_weights");
+			InitMap();
+			Normalize();
+			Minimize(mode, max_error);
+		}
+		SetCoords(uv_);
+		if (solution_cache_)
+			solution_cache_->Insert(key, sliced_mesh_, original_vertex_, cone_vts_);
+	}
+	return sliced_mesh_;
+}
+
+void HyperbolicOrbifoldSolver::Minimize(int mode, double error)
 {
 	using namespace Eigen;
 	using namespace LBFGSpp;
 
-	if (mesh_.n_vertices() > 10) {
-		InitOrbifold();
-		ComputeCornerAngles();
-		ComputeHalfedgeWeights();
-		InitMap();
-		Normalize();
-		this->ComputeGradient();
-		std::function<double(const VectorXd&, VectorXd&)> fun=
-			[this](const VectorXd& x, VectorXd& grad) ->double 
-		{
-			this->SetCoords(x);
-			this->Normalize();
-			this->ComputeGradient();
-			grad = this->GetGradientVector();
-			return this->ComputeEnergy();
-		};
-
-		LBFGSParam<double> param;
-		param.epsilon = max_error;
-		param.max_iterations = 2000;
-		LBFGSSolver<double> solver(param);
-		VectorXd x = GetCoordsVector();
-		
-		double fx;
-		int niter = solver.minimize(fun, x, fx);
+	BuildEnergyData();
+	BuildVariables();
+	iteration_ = 0;
+	uv_ = GetCoordsVector();
+	Normalize(uv_);
 
+	if (mode & HYPERBOLIC_NEWTON) {
+		timer_.Start("newton");
+		int niter = NewtonSolve(error);
+		timer_.Stop("newton");
+		std::cout << niter << " Newton iterations" << std::endl;
+		std::cout << "f(x) = " << CoordsEnergy(uv_) << std::endl;
+		return;
+	}
+	if (mode & HYPERBOLIC_PRECONDITIONED) {
+		timer_.Start("lbfgs");
+		int niter = PreconditionedLBFGSSolve(error);
+		timer_.Stop("lbfgs");
 		std::cout << niter << " iterations" << std::endl;
-		std::cout << "f(x) = " << fx << std::endl;
+		std::cout << "f(x) = " << CoordsEnergy(uv_) << std::endl;
+		return;
+	}
+	if (mode & HYPERBOLIC_RIEMANNIAN) {
+		timer_.Start("riemannian");
+		int niter = RiemannianSolve(error);
+		timer_.Stop("riemannian");
+		std::cout << niter << " Riemannian iterations" << std::endl;
+		std::cout << "f(x) = " << CoordsEnergy(uv_) << std::endl;
+		return;
+	}
 
+	Objective fun = { *this };
+
+	LBFGSParam<double> param;
+	param.epsilon = error;
+	param.max_iterations = 2000;
+	param.linesearch = LBFGS_LINESEARCH_BACKTRACKING_ARMIJO;
+	LBFGSSolver<double, EnergyFirstLineSearch> solver(param);
+	VectorXd uv_start = uv_;
+	VectorXd y = ReduceVariables(uv_);
+
+	double fx;
+	int niter;
+	timer_.Start("lbfgs");
+	try {
+		niter = solver.minimize(fun, y, fx);
+	}
+	catch (const std::runtime_error &e) {
+		// y is the last accepted iterate.
+		std::cerr << "Warning: " << e.what() << std::endl;
+		niter = iteration_;
+	}
+	timer_.Stop("lbfgs");
+	ExpandResult(y, uv_start);
+
+	std::cout << niter << " iterations" << std::endl;
+	std::cout << "f(x) = " << fx << std::endl;
+}
+
+bool HyperbolicOrbifoldSolver::WarmStart(const HyperbolicSolutionKey & key)
+{
+	using namespace OpenMesh;
+	if (!solution_cache_) return false;
+	const HyperbolicSolution *solution = solution_cache_->Closest(key);
+	if (!solution) return false;
+	SurfaceMesh &mesh = sliced_mesh_;
+	int n_vertices = mesh.n_vertices();
+
+	timer_.Start("warm_start");
+	std::vector<std::vector<Vec2d>> copies(mesh_.n_vertices());
+	for (int i = 0; i < solution->original_vertex.size(); ++i)
+		copies[solution->original_vertex[i]].push_back(solution->sliced_mesh.texcoord2D(VertexHandle(i)));
+
+	std::vector<bool> old_cone(mesh_.n_vertices(), false);
+	for (auto it = solution->key.cones.begin(); it != solution->key.cones.end(); ++it)
+		old_cone[*it] = true;
+
+	// Cones keep the layout of InitOrbifold and vertices with one copy take it. The others
+	// take the copy closest to an assigned neighbor, in breadth first order from those.
+	// A former cone sits where a moved cone may be now, it takes the mean of its neighbors.
+	std::vector<bool> assigned(n_vertices, false);
+	std::vector<int> queue;
+	for (int i = 0; i < n_vertices; ++i) {
+		VertexHandle v(i);
+		const std::vector<Vec2d> &uvs = copies[original_vertex_[i]];
+		if (!mesh.data(v).is_singularity()) {
+			if (uvs.size() != 1 || old_cone[original_vertex_[i]]) continue;
+			mesh.set_texcoord2D(v, uvs.front());
+		}
+		assigned[i] = true;
+		queue.push_back(i);
+	}
+	for (int head = 0; head < queue.size(); ++head) {
+		VertexHandle v(queue[head]);
+		Vec2d uv = mesh.texcoord2D(v);
+		for (auto vviter = mesh.vv_iter(v); vviter.is_valid(); ++vviter) {
+			VertexHandle w = *vviter;
+			if (assigned[w.idx()]) continue;
+			if (old_cone[original_vertex_[w.idx()]]) {
+				Vec2d mean(0, 0);
+				int n_assigned = 0;
+				for (auto wviter = mesh.vv_iter(w); wviter.is_valid(); ++wviter) {
+					if (!assigned[(*wviter).idx()]) continue;
+					mean += mesh.texcoord2D(*wviter);
+					++n_assigned;
+				}
+				mesh.set_texcoord2D(w, mean / n_assigned);
+			}
+			else {
+				const std::vector<Vec2d> &uvs = copies[original_vertex_[w.idx()]];
+				Vec2d closest = uvs.front();
+				for (auto it = uvs.begin(); it != uvs.end(); ++it) {
+					if ((*it - uv).sqrnorm() < (closest - uv).sqrnorm())
+						closest = *it;
+				}
+				mesh.set_texcoord2D(w, closest);
+			}
+			assigned[w.idx()] = true;
+			queue.push_back(w.idx());
+		}
+	}
+	timer_.Stop("warm_start");
+
+	timer_.Start("angles_weights");
+	ComputeHalfedgeWeights();
+	timer_.Stop("angles_weights");
+	Normalize();
+	if (HyperbolicSolutionCache::MarkerDistance(solution->key, key) == 0) {
+		std::cout << "Warm start from a cached solution" << std::endl;
+		return true;
+	}
+
+	// A different cut leaves the mapped solution folded along the old cut.
+	BuildEnergyData();
+	Eigen::VectorXd warm_uv = GetCoordsVector();
+	uv_ = warm_uv;
+	double warm_energy = CoordsEnergy(uv_);
+	InitMap();
+	Normalize();
+	uv_ = GetCoordsVector();
+	double harmonic_energy = CoordsEnergy(uv_);
+	if (warm_energy < harmonic_energy) {
+		SetCoords(warm_uv);
+		std::cout << "Warm start from a cached solution" << std::endl;
+	}
+	return true;
+}
+
+bool HyperbolicOrbifoldSolver::ReportIteration(double energy, double gradient_norm, double step, int evaluations)
+{
+	++iteration_;
+	if (!iteration_callback_) return true;
+	HyperbolicIteration info;
+	info.level = level_;
+	info.iteration = iteration_;
+	info.energy = energy;
+	info.gradient_norm = gradient_norm;
+	info.step = step;
+	info.evaluations = evaluations;
+	info.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count();
+	return iteration_callback_(info);
+}
+
+void HyperbolicOrbifoldSolver::SolveMultilevel(int mode)
+{
+	using namespace OpenMesh;
+
+	// Cones stay on every level and cut vertices are removed in pairs, so the segments
+	// and the isometries only need to be reindexed.
+	timer_.Start("hierarchy");
+	std::vector<bool> keep(sliced_mesh_.n_vertices());
+	for (auto viter = sliced_mesh_.vertices_begin(); viter != sliced_mesh_.vertices_end(); ++viter) {
+		VertexHandle v = *viter;
+		keep[v.idx()] = sliced_mesh_.data(v).is_singularity();
+	}
+	MeshHierarchy hierarchy(sliced_mesh_);
+	hierarchy.Build(keep, multilevel_min_vertices_);
+	timer_.Stop("hierarchy");
+
+	std::vector<VertexHandle> cone_vts = cone_vts_;
+	std::vector<std::vector<VertexHandle>> segments_vts = segments_vts_;
+	std::vector<int> vertex_segment = vertex_segment_;
+
+	// Solve on the input, on the coarsest level, and on the levels closest to a geometric
+	// sequence of sizes with ratio about multilevel_ratio_ in between.
+	// The other levels are only interpolated.
+	int n_levels = hierarchy.NumLevels();
+	std::vector<bool> solve_level(n_levels + 1, false);
+	solve_level[0] = solve_level[n_levels] = true;
+	double n_fine = hierarchy.Mesh(0).n_vertices(), n_coarse = hierarchy.Mesh(n_levels).n_vertices();
+	int steps = std::max(1, int(std::round(std::log(n_fine / n_coarse) / std::log(multilevel_ratio_))));
+	for (int i = 1; i < steps; ++i) {
+		double target = n_coarse * std::pow(n_fine / n_coarse, double(i) / steps);
+		int best = 0;
+		for (int level = 1; level <= n_levels; ++level) {
+			if (std::abs(std::log(hierarchy.Mesh(level).n_vertices() / target)) < std::abs(std::log(hierarchy.Mesh(best).n_vertices() / target)))
+				best = level;
+		}
+		solve_level[best] = true;
+	}
+
+	Eigen::VectorXd coarse_uv;
+	for (int level = n_levels; level >= 0; --level) {
+		int n_vertices = hierarchy.Mesh(level).n_vertices();
+		if (level < n_levels) {
+			timer_.Start("prolongation");
+			Eigen::VectorXd uv;
+			hierarchy.Prolongate(level + 1, coarse_uv, uv, 2);
+			coarse_uv.swap(uv);
+			timer_.Stop("prolongation");
+		}
+		if (!solve_level[level]) continue;
+
+		if (level > 0) {
+			for (int i = 0; i < cone_vts_.size(); ++i)
+				cone_vts_[i] = VertexHandle(hierarchy.FromInput(level, cone_vts[i].idx()));
+			for (int i = 0; i < segments_vts_.size(); ++i) {
+				segments_vts_[i].clear();
+				for (int j = 0; j < segments_vts[i].size(); ++j) {
+					int v = hierarchy.FromInput(level, segments_vts[i][j].idx());
+					if (v >= 0) segments_vts_[i].push_back(VertexHandle(v));
+				}
+			}
+			vertex_segment_.assign(n_vertices, -1);
+			for (int i = 0; i < vertex_segment.size(); ++i) {
+				int v = hierarchy.FromInput(level, i);
+				if (v >= 0) vertex_segment_[v] = vertex_segment[i];
+			}
+			std::swap(sliced_mesh_, hierarchy.Mesh(level));
+		}
+		else {
+			cone_vts_ = cone_vts;
+			segments_vts_ = segments_vts;
+			vertex_segment_ = vertex_segment;
+		}
+		std::cout << "Level " << level << ": " << n_vertices << " vertices" << std::endl;
+		level_ = level;
+
+		timer_.Start("angles_weights");
+		ComputeHalfedgeWeights();
+		timer_.Stop("angles_weights");
+		if (level == n_levels)
+			InitMap();
+		else
+			SetCoords(coarse_uv);
+		Normalize();
+		// Coarse levels only need to be as accurate as their discretization.
+		Minimize(mode, level > 0 ? multilevel_error_ : max_error);
+
+		coarse_uv = uv_;
+		if (level > 0)
+			std::swap(sliced_mesh_, hierarchy.Mesh(level));
 	}
-	return sliced_mesh_;
 }
 
 void HyperbolicOrbifoldSolver::InitOrbifold()
@@ -57,10 +325,13 @@ void HyperbolicOrbifoldSolver::InitOrbifold()
 		}
 	}
 	OrbifoldInitializer initializer(mesh_);
+	timer_.Start("slicing");
 	initializer.Initiate(sliced_mesh_, cone_flag_, cone_angle_, slice_flag_);
-	initializer.ComputeHyperbolicTransformations(sliced_mesh_, vtx_transit_);
+	timer_.Stop("slicing");
+	initializer.ComputeHyperbolicTransformations(sliced_mesh_, transit_, vertex_segment_);
 	cone_vts_ = initializer.GetConeVertices();
 	segments_vts_ = initializer.GetSegments();
+	original_vertex_ = initializer.GetOriginalVertices();
 
 	std::cout << "Cone coordinates:\n";
 	for (int i = 0; i < cone_vts_.size(); ++i) {
@@ -91,73 +362,16 @@ void HyperbolicOrbifoldSolver::InitiateBoundaryData()
 
 }
 
-double HyperbolicOrbifoldSolver::CosineLaw(double a, double b, double c)
-{
-	//double cs = (cosh(a) * cosh(b) - cosh(c)) / (sinh(a) * sinh(b));
-	double cs = (a * a + b * b - c * c) / (2 * a * b);
-	assert(-1 <= cs && cs <= 1);
-	return acos(cs);
-
-}
-
 double HyperbolicOrbifoldSolver::AngleCosineLaw(double a, double b, double c)
 {
 	double l = (cos(c) + cos(a)*cos(b)) / (sin(a) * sin(b));
 	return acosh(l);
 }
 
-void HyperbolicOrbifoldSolver::ComputeCornerAngles()
-{
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-	for (auto fiter = mesh.faces_begin(); fiter != mesh.faces_end(); ++fiter) {
-		FaceHandle f = *fiter;
-		std::vector<HalfedgeHandle> he;
-
-		for (auto fhiter = mesh.fh_iter(f); fhiter.is_valid(); ++fhiter) {
-			he.push_back(*fhiter);
-		}
-		double l[3];
-		l[0] = mesh.calc_edge_length(mesh.edge_handle(he[0]));
-		l[1] = mesh.calc_edge_length(mesh.edge_handle(he[1]));
-		l[2] = mesh.calc_edge_length(mesh.edge_handle(he[2]));
-		for (int i = 0; i < 3; ++i) {
-			double cs = CosineLaw(l[i], l[(i + 1) % 3], l[(i + 2) % 3]);
-			mesh.data(he[i]).set_angle(cs);
-		}
-	}
-}
-
 void HyperbolicOrbifoldSolver::ComputeHalfedgeWeights()
 {
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-
-	ComputeCornerAngles();
-	for (auto eiter = mesh.edges_begin(); eiter != mesh.edges_end(); ++eiter) {
-		EdgeHandle e = *eiter;
-		HalfedgeHandle h0 = mesh.halfedge_handle(e, 0);
-		HalfedgeHandle h1 = mesh.halfedge_handle(e, 1);
-		HalfedgeHandle h0_next;
-		if (!mesh.is_boundary(h0))
-			h0_next = mesh.next_halfedge_handle(h0);
-		HalfedgeHandle h1_next;
-		if (!mesh.is_boundary(h1))
-			h1_next = mesh.next_halfedge_handle(h1);
-
-		double weight = 0.;
-
-		if (h0_next.is_valid())
-			weight += 1. / tan(mesh.data(h0_next).angle());
-		if (h1_next.is_valid())
-			weight += 1. / tan(mesh.data(h1_next).angle());
-		weight *= 0.5;
-		if (weight < 0)
-			weight = 0.01;
-		mesh.data(h0).set_weight(weight);
-		mesh.data(h1).set_weight(weight);
-	}
-
+	geometry_.Build(sliced_mesh_);
+	geometry_.ClampNegativeWeights(0.01);
 }
 
 void HyperbolicOrbifoldSolver::ComputeEdgeLength()
@@ -178,187 +392,662 @@ void HyperbolicOrbifoldSolver::ComputeEdgeLength()
 	}
 }
 
-double HyperbolicOrbifoldSolver::ComputeGradient()
+Eigen::VectorXd HyperbolicOrbifoldSolver::GetCoordsVector()
 {
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	double max_gradient_norm = 0.0;
+	Eigen::VectorXd uv_vector(mesh.n_vertices() * 2);
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
-		Vec2d gradient = ComputeGradient(v);
-		mesh.data(v).set_gradient(gradient);
-		if (gradient.norm() > max_gradient_norm) {
-			max_gradient_norm = gradient.norm();
-		}
+		Vec2d uv = mesh.texcoord2D(v);
+		uv_vector(v.idx() * 2) = uv[0];
+		uv_vector(v.idx() * 2 + 1) = uv[1];
 	}
-	return max_gradient_norm;
+	return uv_vector;
 }
 
-OpenMesh::Vec2d HyperbolicOrbifoldSolver::ComputeGradientOfDistance2(Complex src_complex, Complex dst_complex)
+void HyperbolicOrbifoldSolver::SetCoords(const Eigen::VectorXd & uv_vector)
 {
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	
-	Vec2d src_uv(src_complex.real(), src_complex.imag());
-	Vec2d dst_uv(dst_complex.real(), dst_complex.imag());
-	Vec2d diff = src_uv - dst_uv;
-	double distance = HyperbolicDistance(src_complex, dst_complex);
-
-	double f = 1 + 2 * pow(diff.norm(), 2) / ((1 - pow(src_uv.norm(), 2))*(1 - pow(dst_uv.norm(), 2)));
-	double darccosh = 1 / sqrt(f * f - 1);
-	double constant_df = 4. / ((1 - pow(dst_uv.norm(), 2))*(1 - pow(src_uv.norm(), 2)));
-	Vec2d vector_df = diff + pow(diff.norm(), 2) * src_uv / (1 - pow(src_uv.norm(), 2));
-	return distance * darccosh * constant_df * vector_df;
+	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
+		VertexHandle v = *viter;
+		Vec2d uv(uv_vector(v.idx() * 2), uv_vector(v.idx() * 2 + 1));
+		mesh.set_texcoord2D(v, uv);
+	}
 }
 
-OpenMesh::Vec2d HyperbolicOrbifoldSolver::ComputeGradient(OpenMesh::VertexHandle v)
+void HyperbolicOrbifoldSolver::Normalize()
 {
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
+	for (auto it = segments_vts_.begin(); it != segments_vts_.end(); ++it) {
+		for (auto viter = (*it).begin(); viter != (*it).end(); ++viter) {
+			VertexHandle v = *viter;
+			if (mesh.data(v).is_singularity()) continue;
+			VertexHandle equiv = mesh.data(v).equivalent_vertex();
+			Vec2d equiv_uv = mesh.texcoord2D(equiv);
+			Complex equiv_complex(equiv_uv[0], equiv_uv[1]);
+			Complex v_complex = transit_[vertex_segment_[equiv.idx()]](equiv_complex);
+			Vec2d v_uv(v_complex.real(), v_complex.imag());
+			mesh.set_texcoord2D(v, v_uv);
+		}
+	}
+}
 
-	if (mesh.data(v).is_singularity()) {
-		return Vec2d(0, 0);
+void HyperbolicOrbifoldSolver::Normalize(Eigen::VectorXd & uv)
+{
+	using namespace OpenMesh;
+	SurfaceMesh &mesh = sliced_mesh_;
+	for (auto it = segments_vts_.begin(); it != segments_vts_.end(); ++it) {
+		for (auto viter = (*it).begin(); viter != (*it).end(); ++viter) {
+			VertexHandle v = *viter;
+			if (mesh.data(v).is_singularity()) continue;
+			VertexHandle equiv = mesh.data(v).equivalent_vertex();
+			Complex equiv_complex(uv(2 * equiv.idx()), uv(2 * equiv.idx() + 1));
+			Complex v_complex = transit_[vertex_segment_[equiv.idx()]](equiv_complex);
+			uv(2 * v.idx()) = v_complex.real();
+			uv(2 * v.idx() + 1) = v_complex.imag();
+		}
 	}
-	Vec2d v_uv = mesh.texcoord2D(v);
-	Complex v_complex(v_uv[0], v_uv[1]);
+}
 
-	Vec2d gradient(0, 0);
+void HyperbolicOrbifoldSolver::BuildEnergyData()
+{
+	using namespace OpenMesh;
+	SurfaceMesh &mesh = sliced_mesh_;
+	int n_edges = mesh.n_edges();
+	int n_vertices = mesh.n_vertices();
 
-	for (SurfaceMesh::VertexOHalfedgeIter vohiter = mesh.voh_iter(v); vohiter.is_valid(); ++vohiter) {
-		HalfedgeHandle h = *vohiter;
-		VertexHandle neighbor = mesh.to_vertex_handle(h);
-		auto neighbor_uv = mesh.texcoord2D(neighbor);
-		Complex neighbor_complex(neighbor_uv[0], neighbor_uv[1]);
-		double n_w = mesh.data(h).weight();
-		assert(n_w > 0);
-		gradient += n_w * ComputeGradientOfDistance2(v_complex, neighbor_complex);
+	edge_vertex_.resize(2 * n_edges);
+	edge_weight_.resize(n_edges);
+	for (int i = 0; i < n_edges; ++i) {
+		HalfedgeHandle h = mesh.halfedge_handle(EdgeHandle(i), 0);
+		edge_vertex_[2 * i] = mesh.from_vertex_handle(h).idx();
+		edge_vertex_[2 * i + 1] = mesh.to_vertex_handle(h).idx();
+		edge_weight_[i] = geometry_.Weight(h);
 	}
 
-	if (!mesh.is_boundary(v)) return gradient;
+	vertex_edge_offset_.assign(n_vertices + 1, 0);
+	vertex_edge_.clear();
+	vertex_edge_.reserve(2 * n_edges);
+	for (int i = 0; i < n_vertices; ++i) {
+		for (auto vohiter = mesh.voh_iter(VertexHandle(i)); vohiter.is_valid(); ++vohiter) {
+			HalfedgeHandle h = *vohiter;
+			vertex_edge_.push_back(2 * mesh.edge_handle(h).idx() + (h.idx() & 1));
+		}
+		vertex_edge_offset_[i + 1] = vertex_edge_.size();
+	}
 
-	VertexHandle equiv = mesh.data(v).equivalent_vertex();
+	edge_coords_.resize(4 * n_edges);
+	edge_distance_.resize(n_edges);
+	edge_energy_.resize(n_edges);
+	edge_gradient_.resize(4 * n_edges);
+}
 
-	for (SurfaceMesh::VertexOHalfedgeIter vohiter = mesh.voh_iter(equiv); vohiter.is_valid(); ++vohiter) {
-		HalfedgeHandle h = *vohiter;
-		VertexHandle neighbor = mesh.to_vertex_handle(h);
-		auto neighbor_uv = mesh.texcoord2D(neighbor);
-		Complex neighbor_complex(neighbor_uv[0], neighbor_uv[1]);
-		std::function<Complex(Complex const)> transformation = mesh.property(vtx_transit_, equiv);
-		neighbor_complex = transformation(neighbor_complex);
-		double n_w = mesh.data(h).weight();
-		gradient += n_w * ComputeGradientOfDistance2(v_complex, neighbor_complex);
+void HyperbolicOrbifoldSolver::EvaluateEdges(const Eigen::VectorXd & uv, bool gradient)
+{
+	int n_edges = edge_weight_.size();
+	double *x0 = edge_coords_.data(), *y0 = x0 + n_edges, *x1 = y0 + n_edges, *y1 = x1 + n_edges;
+	double *gx0 = edge_gradient_.data(), *gy0 = gx0 + n_edges, *gx1 = gy0 + n_edges, *gy1 = gx1 + n_edges;
+	int n_blocks = (n_edges + EDGE_BLOCK - 1) / EDGE_BLOCK;
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int b = 0; b < n_blocks; ++b) {
+		int begin = b * EDGE_BLOCK, n = std::min(EDGE_BLOCK, n_edges - begin);
+		for (int i = begin; i < begin + n; ++i) {
+			int v0 = edge_vertex_[2 * i], v1 = edge_vertex_[2 * i + 1];
+			x0[i] = uv(2 * v0);
+			y0[i] = uv(2 * v0 + 1);
+			x1[i] = uv(2 * v1);
+			y1[i] = uv(2 * v1 + 1);
+		}
+		if (gradient)
+			HyperbolicDistance2Gradients(x0 + begin, y0 + begin, x1 + begin, y1 + begin, &edge_distance_[begin],
+				gx0 + begin, gy0 + begin, gx1 + begin, gy1 + begin, n);
+		else
+			HyperbolicDistances(x0 + begin, y0 + begin, x1 + begin, y1 + begin, &edge_distance_[begin], n);
+		for (int i = begin; i < begin + n; ++i)
+			edge_energy_[i] = edge_weight_[i] * edge_distance_[i] * edge_distance_[i];
 	}
-	double metric_factor = pow(1 - pow(v_uv.norm(), 2), 2) / 4.;
-	return gradient * metric_factor;
 }
 
-double HyperbolicOrbifoldSolver::ComputeEnergy()
+double HyperbolicOrbifoldSolver::CoordsEnergy(const Eigen::VectorXd & uv)
 {
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
+	EvaluateEdges(uv, false);
+	// Both halfedges of an edge carry the same weight, so the halfedge sum halves to an edge sum.
 	double energy = 0;
-	for (auto hiter = mesh.halfedges_begin(); hiter != mesh.halfedges_end(); ++hiter) {
-		HalfedgeHandle h = *hiter;
-		VertexHandle v = mesh.from_vertex_handle(h);
-		VertexHandle tv = mesh.to_vertex_handle(h);
-		Vec2d v_uv = mesh.texcoord2D(v);
-		Vec2d tv_uv = mesh.texcoord2D(tv);
-		Complex v_complex(v_uv[0], v_uv[1]);
-		Complex tv_complex(tv_uv[0], tv_uv[1]);
-		double weight = mesh.data(h).weight();
-		energy += weight * pow(HyperbolicDistance(v_complex, tv_complex), 2);
-	}
-	return energy * 0.5;
+	for (int i = 0; i < edge_energy_.size(); ++i)
+		energy += edge_energy_[i];
+	return energy;
 }
 
-Eigen::VectorXd HyperbolicOrbifoldSolver::GetCoordsVector()
+double HyperbolicOrbifoldSolver::Energy(const Eigen::VectorXd & y)
+{
+	if (!ExpandVariables(y, uv_))
+		return std::numeric_limits<double>::infinity();
+	return CoordsEnergy(uv_);
+}
+
+double HyperbolicOrbifoldSolver::EnergyAndGradient(const Eigen::VectorXd & y, Eigen::VectorXd & grad)
 {
 	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-	Eigen::VectorXd uv_vector(mesh.n_vertices() * 2);
-	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
-		VertexHandle v = *viter;
-		Vec2d uv = mesh.texcoord2D(v);
-		uv_vector(v.idx() * 2) = uv[0];
-		uv_vector(v.idx() * 2 + 1) = uv[1];
+	grad.setZero(y.size());
+	if (!ExpandVariables(y, uv_))
+		return std::numeric_limits<double>::infinity();
+	int n_edges = edge_weight_.size();
+	int n_variables = variable_vertex_.size();
+	EvaluateEdges(uv_, true);
+
+	// Gradient of each variable vertex and, through the Jacobian of the segment isometry
+	// (the complex derivative), of the copy that follows it.
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int k = 0; k < n_variables; ++k) {
+		int i = variable_vertex_[k];
+		Vec2d gradient(0, 0);
+		for (int j = vertex_edge_offset_[i]; j < vertex_edge_offset_[i + 1]; ++j) {
+			int e = vertex_edge_[j] >> 1, side = vertex_edge_[j] & 1;
+			gradient += edge_weight_[e] * Vec2d(edge_gradient_[2 * side * n_edges + e], edge_gradient_[(2 * side + 1) * n_edges + e]);
+		}
+		int copy = variable_copy_[k];
+		if (copy >= 0) {
+			Vec2d copy_gradient(0, 0);
+			for (int j = vertex_edge_offset_[copy]; j < vertex_edge_offset_[copy + 1]; ++j) {
+				int e = vertex_edge_[j] >> 1, side = vertex_edge_[j] & 1;
+				copy_gradient += edge_weight_[e] * Vec2d(edge_gradient_[2 * side * n_edges + e], edge_gradient_[(2 * side + 1) * n_edges + e]);
+			}
+			Complex c = transit_[vertex_segment_[i]].Derivative(Complex(uv_(2 * i), uv_(2 * i + 1)));
+			gradient += Vec2d(c.real() * copy_gradient[0] + c.imag() * copy_gradient[1], -c.imag() * copy_gradient[0] + c.real() * copy_gradient[1]);
+		}
+		grad(2 * k) = gradient[0];
+		grad(2 * k + 1) = gradient[1];
 	}
-	return uv_vector;
+
+	double energy = 0;
+	for (int i = 0; i < n_edges; ++i)
+		energy += edge_energy_[i];
+	return energy;
 }
 
-Eigen::VectorXd HyperbolicOrbifoldSolver::GetGradientVector()
+void HyperbolicOrbifoldSolver::BuildVariables()
 {
 	using namespace OpenMesh;
 	SurfaceMesh &mesh = sliced_mesh_;
-	Eigen::VectorXd gradient_vector(mesh.n_vertices() * 2);
-	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
-		VertexHandle v = *viter;
-		Vec2d grad = mesh.data(v).gradient();
-		gradient_vector(v.idx() * 2) = grad[0];
-		gradient_vector(v.idx() * 2 + 1) = grad[1];
+	int n_vertices = mesh.n_vertices();
+	vertex_variable_.assign(n_vertices, -1);
+	vertex_master_.resize(n_vertices);
+	variable_vertex_.clear();
+	variable_copy_.clear();
+
+	// Normalize sets the copy in the lower segment from the one in the higher segment.
+	for (int i = 0; i < n_vertices; ++i) {
+		VertexHandle v(i);
+		vertex_master_[i] = i;
+		if (mesh.data(v).is_singularity()) continue;
+		if (mesh.is_boundary(v)) {
+			int equiv = mesh.data(v).equivalent_vertex().idx();
+			if (vertex_segment_[i] < vertex_segment_[equiv]) {
+				vertex_master_[i] = equiv;
+				continue;
+			}
+		}
+		vertex_variable_[i] = variable_vertex_.size();
+		variable_vertex_.push_back(i);
+	}
+	variable_copy_.assign(variable_vertex_.size(), -1);
+	for (int i = 0; i < n_vertices; ++i) {
+		if (vertex_master_[i] != i) {
+			vertex_variable_[i] = vertex_variable_[vertex_master_[i]];
+			variable_copy_[vertex_variable_[i]] = i;
+		}
 	}
-	return gradient_vector;
 }
 
-void HyperbolicOrbifoldSolver::SetCoords(const Eigen::VectorXd & uv_vector)
+Eigen::VectorXd HyperbolicOrbifoldSolver::ReduceVariables(const Eigen::VectorXd & uv)
 {
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
-		VertexHandle v = *viter;
-		Vec2d uv(uv_vector(v.idx() * 2), uv_vector(v.idx() * 2 + 1));
-		mesh.set_texcoord2D(v, uv);
+	Eigen::VectorXd y(2 * variable_vertex_.size());
+	for (int k = 0; k < variable_vertex_.size(); ++k)
+		y.segment(2 * k, 2) = uv.segment(2 * variable_vertex_[k], 2);
+	return y;
+}
+
+bool HyperbolicOrbifoldSolver::ExpandVariables(const Eigen::VectorXd & y, Eigen::VectorXd & uv)
+{
+	int n_vertices = vertex_variable_.size();
+	for (int k = 0; k < variable_vertex_.size(); ++k) {
+		int i = variable_vertex_[k];
+		uv(2 * i) = y(2 * k);
+		uv(2 * i + 1) = y(2 * k + 1);
 	}
+	for (int i = 0; i < n_vertices; ++i) {
+		int master = vertex_master_[i];
+		if (master != i) {
+			Complex p = transit_[vertex_segment_[master]](Complex(uv(2 * master), uv(2 * master + 1)));
+			uv(2 * i) = p.real();
+			uv(2 * i + 1) = p.imag();
+		}
+		if (uv(2 * i) * uv(2 * i) + uv(2 * i + 1) * uv(2 * i + 1) >= 1.)
+			return false;
+	}
+	return true;
 }
 
-double HyperbolicOrbifoldSolver::OptimizationLoop(double step_length, double error)
+void HyperbolicOrbifoldSolver::ExpandResult(const Eigen::VectorXd & y, const Eigen::VectorXd & uv_start)
 {
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-	//double energy_prev = 1e10;
-	//double energy = ComputeEnergy();
-	int epoch = 0;
-	double gradient_length = 1e10;
-	while (gradient_length > error) {
-		gradient_length = ComputeGradient();
-		if (epoch % 20) {
-			std::cout << "Max Gradient Length:" << gradient_length << "\tEnergy:" << ComputeEnergy() << std::endl;
-		}
-		
-		for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
-			VertexHandle v = *viter;
-			Vec2d uv = mesh.texcoord2D(v);
-			Vec2d gradient = mesh.data(v).gradient();
-			
-			Complex uv_complex(uv[0], uv[1]);
-			uv -= step_length * gradient;
-			assert(uv.norm() < 1);
-			mesh.set_texcoord2D(v, uv);
+	if (!ExpandVariables(y, uv_)) {
+		std::cerr << "Warning: a vertex left the disk, the start coordinates are kept" << std::endl;
+		uv_ = uv_start;
+	}
+}
+
+double HyperbolicOrbifoldSolver::EdgeEnergyHessian(const Eigen::Vector2d & p0, const Eigen::Vector2d & p1, double w, Eigen::Vector4d & g, Eigen::Matrix4d & H)
+{
+	using namespace Eigen;
+	// d = acosh(f), f = 1 + 2 q / P with q = |p0 - p1|^2 and P = (1 - |p0|^2)(1 - |p1|^2).
+	Vector2d diff = p0 - p1;
+	double q = diff.squaredNorm();
+	double s0 = 1 - p0.squaredNorm();
+	double s1 = 1 - p1.squaredNorm();
+	double P = s0 * s1;
+	double f = 1 + 2 * q / P;
+
+	Vector4d dq, dP;
+	dq << 2 * diff, -2 * diff;
+	dP << -2 * s1 * p0, -2 * s0 * p1;
+	Matrix4d Hq = Matrix4d::Zero(), HP = Matrix4d::Zero();
+	Hq.block<2, 2>(0, 0) = Hq.block<2, 2>(2, 2) = 2 * Matrix2d::Identity();
+	Hq.block<2, 2>(0, 2) = Hq.block<2, 2>(2, 0) = -2 * Matrix2d::Identity();
+	HP.block<2, 2>(0, 0) = -2 * s1 * Matrix2d::Identity();
+	HP.block<2, 2>(2, 2) = -2 * s0 * Matrix2d::Identity();
+	HP.block<2, 2>(0, 2) = 4 * p0 * p1.transpose();
+	HP.block<2, 2>(2, 0) = 4 * p1 * p0.transpose();
+
+	Vector4d df = 2 * (dq / P - q * dP / (P * P));
+	Matrix4d Hf = 2 * (Hq / P - (dq * dP.transpose() + dP * dq.transpose()) / (P * P)
+		+ 2 * q * dP * dP.transpose() / (P * P * P) - q * HP / (P * P));
+
+	// Derivatives of acosh(f)^2, with their limits at f = 1.
+	double d = HyperbolicDistance(Complex(p0(0), p0(1)), Complex(p1(0), p1(1)));
+	double g1 = 2., g2 = -2. / 3.;
+	if (f - 1 > 1e-8) {
+		double s = sqrt(f * f - 1);
+		g1 = 2 * d / s;
+		g2 = 2 / (s * s) - 2 * d * f / (s * s * s);
+	}
+	g = w * g1 * df;
+	H = w * (g2 * df * df.transpose() + g1 * Hf);
+
+	SelfAdjointEigenSolver<Matrix4d> eigen(H);
+	Vector4d lambda = eigen.eigenvalues();
+	if (lambda.minCoeff() < 0) {
+		lambda = lambda.cwiseMax(0.);
+		H = eigen.eigenvectors() * lambda.asDiagonal() * eigen.eigenvectors().transpose();
+	}
+	return w * d * d;
+}
+
+int HyperbolicOrbifoldSolver::NewtonSolve(double error)
+{
+	using namespace Eigen;
+	int n_edges = edge_weight_.size();
+	int n = 2 * variable_vertex_.size();
+
+	VectorXd uv_start = uv_;
+	VectorXd y = ReduceVariables(uv_);
+	ExpandResult(y, uv_start);
+
+	std::vector<Vector4d> edge_g(n_edges);
+	std::vector<Matrix4d> edge_H(n_edges);
+	std::vector<Triplet<double>> triplets(16 * n_edges);
+	SparseMatrix<double> H(n, n);
+	SimplicialLDLT<SparseMatrix<double>> solver;
+	VectorXd uv_new = uv_;
+	bool full_step = false;
+	double last_step = 0;
+	int last_evaluations = 0;
+
+	int iter = 0;
+	for (;; ++iter) {
+		// Per edge gradient and Hessian w.r.t. the end points.
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+		for (int i = 0; i < n_edges; ++i) {
+			int v0 = edge_vertex_[2 * i], v1 = edge_vertex_[2 * i + 1];
+			edge_energy_[i] = EdgeEnergyHessian(uv_.segment<2>(2 * v0), uv_.segment<2>(2 * v1), edge_weight_[i], edge_g[i], edge_H[i]);
 		}
+		double energy = 0;
+		for (int i = 0; i < n_edges; ++i)
+			energy += edge_energy_[i];
 
-		Normalize();
-		//energy_prev = energy;
-		//energy = ComputeEnergy();
-		epoch++;
+		// Chain rule to the variables. A copy follows its master through a conformal map,
+		// its Jacobian is the complex derivative, the second derivative of the map is dropped.
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+		for (int i = 0; i < n_edges; ++i) {
+			Matrix2d J[2];
+			int var[2];
+			for (int s = 0; s < 2; ++s) {
+				int v = edge_vertex_[2 * i + s];
+				int master = vertex_master_[v];
+				var[s] = vertex_variable_[v];
+				J[s].setIdentity();
+				if (master != v) {
+					Complex c = transit_[vertex_segment_[master]].Derivative(Complex(uv_(2 * master), uv_(2 * master + 1)));
+					J[s] << c.real(), -c.imag(), c.imag(), c.real();
+				}
+			}
+			Triplet<double> *out = &triplets[16 * i];
+			for (int s = 0; s < 2; ++s) {
+				for (int t = 0; t < 2; ++t) {
+					Matrix2d block = J[s].transpose() * edge_H[i].block<2, 2>(2 * s, 2 * t) * J[t];
+					for (int r = 0; r < 2; ++r) {
+						for (int c = 0; c < 2; ++c) {
+							// Fixed vertices write explicit zeros on the diagonal, the pattern stays the same.
+							if (var[s] < 0 || var[t] < 0)
+								*out++ = Triplet<double>(0, 0, 0.);
+							else
+								*out++ = Triplet<double>(2 * var[s] + r, 2 * var[t] + c, block(r, c));
+						}
+					}
+				}
+			}
+		}
+		// Gradient w.r.t. the coordinates of each vertex, then w.r.t. the variables.
+		VectorXd g_uv = VectorXd::Zero(uv_.size());
+		for (int i = 0; i < n_edges; ++i) {
+			g_uv.segment<2>(2 * edge_vertex_[2 * i]) += edge_g[i].segment<2>(0);
+			g_uv.segment<2>(2 * edge_vertex_[2 * i + 1]) += edge_g[i].segment<2>(2);
+		}
+		VectorXd g = VectorXd::Zero(n);
+		// Second order term of the maps, g_uv . T'' at the master of every copy.
+		std::vector<Triplet<double>> map_triplets;
+		for (int v = 0; v < vertex_variable_.size(); ++v) {
+			int var = vertex_variable_[v];
+			if (var < 0) continue;
+			Vector2d gv = g_uv.segment<2>(2 * v);
+			int master = vertex_master_[v];
+			if (master != v) {
+				Complex z(uv_(2 * master), uv_(2 * master + 1));
+				Complex c = transit_[vertex_segment_[master]].Derivative(z);
+				Complex c2 = transit_[vertex_segment_[master]].SecondDerivative(z);
+				double m0 = gv(0) * c2.real() + gv(1) * c2.imag();
+				double m1 = -gv(0) * c2.imag() + gv(1) * c2.real();
+				map_triplets.push_back(Triplet<double>(2 * var, 2 * var, m0));
+				map_triplets.push_back(Triplet<double>(2 * var, 2 * var + 1, m1));
+				map_triplets.push_back(Triplet<double>(2 * var + 1, 2 * var, m1));
+				map_triplets.push_back(Triplet<double>(2 * var + 1, 2 * var + 1, -m0));
+				gv = Vector2d(c.real() * gv(0) + c.imag() * gv(1), -c.imag() * gv(0) + c.real() * gv(1));
+			}
+			g.segment<2>(2 * var) += gv;
+		}
+
+		// The state after a step is complete here, with the gradient at the new point.
+		if (iter > 0 && iteration_callback_ && !ReportIteration(energy, g.norm(), last_step, last_evaluations))
+			break;
+		if (g.norm() <= error * std::max(y.norm(), 1.) || iter >= newton_iterations_)
+			break;
+
+		// Near the minimum (the last step was a full Newton step) the full Hessian is tried,
+		// and kept if it is positive definite. Otherwise the projected one is used,
+		// without the second order term of the maps.
+		H.setFromTriplets(triplets.begin(), triplets.end());
+		timer_.Start("factorization");
+		if (iter == 0)
+			solver.analyzePattern(H);
+		bool factorized = false;
+		if (full_step) {
+			SparseMatrix<double> H_map(n, n);
+			H_map.setFromTriplets(map_triplets.begin(), map_triplets.end());
+			solver.factorize(H + H_map);
+			factorized = solver.info() == Eigen::Success && solver.vectorD().minCoeff() > 0;
+		}
+		if (!factorized)
+			solver.factorize(H);
+		timer_.Stop("factorization");
+		if (solver.info() != Eigen::Success) {
+			std::cerr << "Waring: Eigen decomposition failed" << std::endl;
+			break;
+		}
+		timer_.Start("solve");
+		VectorXd dy = solver.solve(-g);
+		timer_.Stop("solve");
+
+		// Backtracking line search, trial points must stay in the disk.
+		double slope = g.dot(dy);
+		double step = 1.;
+		bool accepted = false;
+		last_evaluations = 0;
+		while (step > 1e-12) {
+			VectorXd y_new = y + step * dy;
+			if (ExpandVariables(y_new, uv_new)) {
+				++last_evaluations;
+				double energy_new = CoordsEnergy(uv_new);
+				if (energy_new <= energy + 1e-4 * step * slope) {
+					full_step = (step == 1.);
+					last_step = step;
+					y = y_new;
+					uv_.swap(uv_new);
+					accepted = true;
+					break;
+				}
+			}
+			step *= 0.5;
+		}
+		if (!accepted)
+			break;
 	}
-	return gradient_length;
+	return iter;
 }
 
-void HyperbolicOrbifoldSolver::Normalize()
+int HyperbolicOrbifoldSolver::RiemannianSolve(double error)
 {
-	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh_;
-	for (auto it = segments_vts_.begin(); it != segments_vts_.end(); ++it) {
-		for (auto viter = (*it).begin(); viter != (*it).end(); ++viter) {
-			VertexHandle v = *viter;
-			if (mesh.data(v).is_singularity()) continue;
-			VertexHandle equiv = mesh.data(v).equivalent_vertex();
-			Vec2d equiv_uv = mesh.texcoord2D(equiv);
-			Complex equiv_complex(equiv_uv[0], equiv_uv[1]);
-			Complex v_complex = mesh.property(vtx_transit_, equiv)(equiv_complex);
-			Vec2d v_uv(v_complex.real(), v_complex.imag());
-			mesh.set_texcoord2D(v, v_uv);
+	using namespace Eigen;
+	int n_variables = variable_vertex_.size();
+	VectorXd uv_start = uv_;
+	VectorXd y = ReduceVariables(uv_);
+	VectorXd g, y_new, g_new;
+	VectorXd direction(2 * n_variables);
+	double energy = EnergyAndGradient(y, g);
+	double step = 1.;
+	double last_step = 0;
+	int last_evaluations = 0;
+
+	int iter = 0;
+	for (;; ++iter) {
+		if (iter > 0 && iteration_callback_ && !ReportIteration(energy, g.norm(), last_step, last_evaluations))
+			break;
+		if (g.norm() <= riemannian_error_factor_ * error * std::max(y.norm(), 1.) || iter >= riemannian_iterations_)
+			break;
+
+		// The Riemannian gradient is the Euclidean one scaled by the inverse metric (1 - |p|^2)^2 / 4.
+		for (int k = 0; k < n_variables; ++k) {
+			double metric = (1. - y.segment<2>(2 * k).squaredNorm()) / 2.;
+			direction.segment<2>(2 * k) = -metric * metric * g.segment<2>(2 * k);
+		}
+		double slope = g.dot(direction);
+
+		bool accepted = false;
+		last_evaluations = 0;
+		y_new.resize(y.size());
+		while (step > 1e-20) {
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+			for (int k = 0; k < n_variables; ++k) {
+				Complex p = ExponentialMap(Complex(y(2 * k), y(2 * k + 1)), step * Complex(direction(2 * k), direction(2 * k + 1)));
+				y_new(2 * k) = p.real();
+				y_new(2 * k + 1) = p.imag();
+			}
+			++last_evaluations;
+			double energy_new = Energy(y_new);
+			if (energy_new <= energy + 1e-4 * step * slope) {
+				accepted = true;
+				break;
+			}
+			step *= 0.5;
+		}
+		if (!accepted)
+			break;
+		last_step = step;
+		double energy_new = EnergyAndGradient(y_new, g_new);
+
+		// Barzilai-Borwein step <s, s> / <s, dg> with the metric at the new point,
+		// tangent vectors are compared in Euclidean coordinates.
+		double ss = 0, sg = 0;
+		for (int k = 0; k < n_variables; ++k) {
+			Vector2d s = y_new.segment<2>(2 * k) - y.segment<2>(2 * k);
+			double metric = 2. / (1. - y_new.segment<2>(2 * k).squaredNorm());
+			ss += metric * metric * s.squaredNorm();
+			sg += s.dot(g_new.segment<2>(2 * k) - g.segment<2>(2 * k));
+		}
+		step = sg > 0 ? std::min(std::max(ss / sg, 1e-10), 1e10) : 2. * step;
+
+		y.swap(y_new);
+		g.swap(g_new);
+		energy = energy_new;
+	}
+	ExpandResult(y, uv_start);
+	return iter;
+}
+
+Eigen::SparseMatrix<double> HyperbolicOrbifoldSolver::PreconditionerMatrix()
+{
+	using namespace Eigen;
+	int n_edges = edge_weight_.size();
+	int n = variable_vertex_.size();
+	std::vector<Triplet<double>> triplets;
+	triplets.reserve(4 * n_edges);
+	for (int i = 0; i < n_edges; ++i) {
+		Complex c[2];
+		int var[2];
+		double conformal = 8. * edge_weight_[i];
+		for (int s = 0; s < 2; ++s) {
+			int v = edge_vertex_[2 * i + s];
+			int master = vertex_master_[v];
+			var[s] = vertex_variable_[v];
+			conformal /= 1. - uv_.segment<2>(2 * v).squaredNorm();
+			c[s] = 1.;
+			if (master != v)
+				c[s] = transit_[vertex_segment_[master]].Derivative(Complex(uv_(2 * master), uv_(2 * master + 1)));
+		}
+		// The edge term is conformal |J0 dp0 - J1 dp1|^2, u and v are decoupled by keeping
+		// the real part of conj(c0) c1, which keeps it positive semidefinite.
+		for (int s = 0; s < 2; ++s) {
+			for (int t = 0; t < 2; ++t) {
+				if (var[s] < 0 || var[t] < 0) continue;
+				double entry = (std::conj(c[s]) * c[t]).real();
+				triplets.push_back(Triplet<double>(var[s], var[t], s == t ? conformal * entry : -conformal * entry));
+			}
 		}
 	}
+	SparseMatrix<double> P(n, n);
+	P.setFromTriplets(triplets.begin(), triplets.end());
+	return P;
+}
+
+static Eigen::VectorXd ApplyPreconditioner(const Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> &preconditioner, const Eigen::VectorXd &x)
+{
+	// The u and v of the variables are the two columns of the right hand side.
+	Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 2, Eigen::RowMajor>> columns(x.data(), x.size() / 2, 2);
+	Eigen::Matrix<double, Eigen::Dynamic, 2, Eigen::RowMajor> result = preconditioner.solve(Eigen::MatrixXd(columns));
+	return Eigen::Map<const Eigen::VectorXd>(result.data(), x.size());
+}
+
+int HyperbolicOrbifoldSolver::PreconditionedLBFGSSolve(double error)
+{
+	using namespace Eigen;
+	timer_.Start("factorization");
+	SimplicialLDLT<SparseMatrix<double>> preconditioner(PreconditionerMatrix());
+	timer_.Stop("factorization");
+	if (preconditioner.info() != Eigen::Success) {
+		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
+		return 0;
+	}
+
+	int n = 2 * variable_vertex_.size();
+	int m = lbfgs_memory_;
+	MatrixXd S(n, m), Y(n, m);
+	VectorXd ys(m), alpha(m);
+	int n_pairs = 0, newest = -1;
+
+	VectorXd uv_start = uv_;
+	VectorXd y = ReduceVariables(uv_);
+	VectorXd g, y_new, g_new, direction;
+	double energy = EnergyAndGradient(y, g);
+	double last_step = 0;
+	int last_evaluations = 0;
+
+	int iter = 0;
+	for (;; ++iter) {
+		if (iter > 0 && iteration_callback_ && !ReportIteration(energy, g.norm(), last_step, last_evaluations))
+			break;
+		if (g.norm() <= error * std::max(y.norm(), 1.) || iter >= lbfgs_iterations_)
+			break;
+
+		// Two loop recursion, the initial inverse Hessian is P^-1. P is the Hessian for short
+		// edges, it is not rescaled by s.y / y.y.
+		direction = -g;
+		for (int k = 0; k < n_pairs; ++k) {
+			int j = (newest - k + m) % m;
+			alpha(j) = S.col(j).dot(direction) / ys(j);
+			direction -= alpha(j) * Y.col(j);
+		}
+		timer_.Start("solve");
+		direction = ApplyPreconditioner(preconditioner, direction);
+		timer_.Stop("solve");
+		for (int k = n_pairs - 1; k >= 0; --k) {
+			int j = (newest - k + m) % m;
+			double beta = Y.col(j).dot(direction) / ys(j);
+			direction += (alpha(j) - beta) * S.col(j);
+		}
+
+		// Backtracking from the full step, energy only at rejected points.
+		double slope = g.dot(direction);
+		if (slope >= 0) {
+			// Not a descent direction, restart from the preconditioned gradient.
+			n_pairs = 0;
+			direction = -ApplyPreconditioner(preconditioner, g);
+			slope = g.dot(direction);
+		}
+		double step = 1.;
+		bool accepted = false;
+		last_evaluations = 0;
+		while (step > 1e-20) {
+			y_new = y + step * direction;
+			++last_evaluations;
+			if (Energy(y_new) <= energy + 1e-4 * step * slope) {
+				accepted = true;
+				break;
+			}
+			step *= 0.5;
+		}
+		if (!accepted)
+			break;
+		last_step = step;
+		double energy_new = EnergyAndGradient(y_new, g_new);
+
+		// Keep the pair if the curvature is positive.
+		VectorXd s_k = y_new - y, y_k = g_new - g;
+		double sy = s_k.dot(y_k);
+		if (sy > 1e-12 * s_k.norm() * y_k.norm()) {
+			newest = (newest + 1) % m;
+			S.col(newest) = s_k;
+			Y.col(newest) = y_k;
+			ys(newest) = sy;
+			n_pairs = std::min(n_pairs + 1, m);
+		}
+
+		y.swap(y_new);
+		g.swap(g_new);
+		energy = energy_new;
+	}
+	ExpandResult(y, uv_start);
+	return iter;
 }
 
 // Compute a harmonic map as a initial map
@@ -370,17 +1059,15 @@ void HyperbolicOrbifoldSolver::InitMap()
 
 	InitiateBoundaryData();
 	
+	timer_.Start("laplacian");
 	SparseMatrix<double> A(mesh.n_vertices() * 2, mesh.n_vertices() * 2);
 	A.setZero();
 	VectorXd b(mesh.n_vertices() * 2);
 
-	std::vector<Triplet<double>> A_coefficients;
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
 		int idx = v.idx();
 		if (mesh.is_boundary(v)) {
-			A_coefficients.push_back(Triplet<double>(2 * idx, 2 * idx, 1.));
-			A_coefficients.push_back(Triplet<double>(2 * idx + 1, 2 * idx + 1, 1.));
 			auto uv = mesh.texcoord2D(v);
 			b(2 * idx) = uv[0];
 			b(2 * idx + 1) = uv[1];
@@ -388,28 +1075,24 @@ void HyperbolicOrbifoldSolver::InitMap()
 		else {
 			b(2 * idx) = 0;
 			b(2 * idx + 1) = 0;
-			double s_w = 0;
-			for (SurfaceMesh::VertexOHalfedgeIter vohiter = mesh.voh_iter(v); vohiter.is_valid(); ++vohiter) {
-				HalfedgeHandle h = *vohiter;
-				VertexHandle neighbor = mesh.to_vertex_handle(h);
-				double n_w = mesh.data(h).weight();
-				s_w += n_w;
-				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * neighbor.idx(), -n_w));
-				A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * neighbor.idx() + 1, -n_w));
-			}
-			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx(), 2 * v.idx(), s_w));
-			A_coefficients.push_back(Eigen::Triplet<double>(2 * v.idx() + 1, 2 * v.idx() + 1, s_w));
 		}
 	}
-	A.setFromTriplets(A_coefficients.begin(), A_coefficients.end());
+	LaplacianAssembler assembler(mesh, geometry_.Weights(), 2);
+	assembler.SetBoundaryRowType(LaplacianAssembler::IDENTITY_ROW);
+	assembler.Assemble(A);
+	timer_.Stop("laplacian");
 	
 	Eigen::SparseLU<Eigen::SparseMatrix<double>> solver;
+	timer_.Start("factorization");
 	solver.compute(A);
+	timer_.Stop("factorization");
 	if (solver.info() != Eigen::Success)
 	{
 		std::cerr << "Waring: Eigen decomposition failed" << std::endl;
 	}
+	timer_.Start("solve");
 	Eigen::VectorXd x = solver.solve(b);
+	timer_.Stop("solve");
 	//std::cout << "Error:" << (A * x - b).norm() << std::endl;
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
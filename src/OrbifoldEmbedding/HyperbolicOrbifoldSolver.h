@@ -5,15 +5,49 @@
 #include "OrbifoldInitializer.h"
 #include <Eigen/Core>
 #include <Eigen/Sparse>
+#include <Eigen/Dense>
 
 #include <HyperbolicGeometry.h>
+#include <StageTimer.h>
+#include <LaplacianAssembler.h>
+#include <GeometryCache.h>
+#include <MeshHierarchy.h>
 
 #include <LBFGS.h>
+#include "EnergyFirstLineSearch.h"
+#include "HyperbolicSolutionCache.h"
+
+#include <chrono>
+#include <functional>
+#include <limits>
 
 #ifndef PI
 #define PI 3.141592653
 #endif
 
+// HYPERBOLIC_MULTILEVEL can be combined with any minimizer, e.g. HYPERBOLIC_NEWTON | HYPERBOLIC_MULTILEVEL.
+// HYPERBOLIC_RIEMANNIAN is Riemannian gradient descent, steps follow geodesics of the disk.
+// HYPERBOLIC_PRECONDITIONED is LBFGS preconditioned with the factorized cotangent Laplacian.
+enum HyperbolicSolverMode { HYPERBOLIC_LBFGS = 0, HYPERBOLIC_NEWTON = 1, HYPERBOLIC_MULTILEVEL = 2, HYPERBOLIC_RIEMANNIAN = 4, HYPERBOLIC_PRECONDITIONED = 8 };
+
+// State after one iteration of the hyperbolic solver, reported to the iteration callback.
+struct HyperbolicIteration {
+	// Level of the multilevel mode, 0 is the input mesh.
+	int level;
+	// 1, 2, ... within the minimization of a level.
+	int iteration;
+	double energy;
+	// Norm of the gradient w.r.t. the variables.
+	double gradient_norm;
+	// Accepted step length and the number of energy evaluations of its line search.
+	double step;
+	int evaluations;
+	// Wall time since Compute started.
+	double seconds;
+};
+
+// Return false to stop the minimization, the current iterate is kept.
+typedef std::function<bool(const HyperbolicIteration &)> HyperbolicIterationCallback;
 
 // This is the implementation of paper Hyperbolic Orbifold Embeddings.
 // The problem is non linear.
@@ -21,8 +55,16 @@ class HyperbolicOrbifoldSolver
 {
 public:
 	HyperbolicOrbifoldSolver(SurfaceMesh &mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::EPropHandleT<bool> slice_flag);
-	SurfaceMesh Compute();
+	// mode is a HyperbolicSolverMode with at most one minimizer bit (Newton, Riemannian or
+	// preconditioned), otherwise an empty mesh is returned.
+	SurfaceMesh Compute(int mode = HYPERBOLIC_LBFGS);
 	std::vector<OpenMesh::VertexHandle> ConeVertices() { return cone_vts_; }
+	StageTimer &Timer() { return timer_; }
+	// Called after every iteration of the minimizers.
+	void SetIterationCallback(HyperbolicIterationCallback callback) { iteration_callback_ = callback; }
+	// With a cache, Compute returns a cached solution of the same mesh, marker and mode,
+	// or starts from the closest cached one, and adds its result to the cache.
+	void SetSolutionCache(HyperbolicSolutionCache *cache) { solution_cache_ = cache; }
 
 protected:
 	SurfaceMesh &mesh_;
@@ -32,37 +74,154 @@ protected:
 	OpenMesh::EPropHandleT<bool> slice_flag_;
 	std::vector<OpenMesh::VertexHandle> cone_vts_;
 	std::vector<std::vector<OpenMesh::VertexHandle>> segments_vts_;
-	OpenMesh::VPropHandleT<std::function<Complex(Complex const)>> vtx_transit_;
+	// Isometry of each boundary segment and the segment of each vertex.
+	std::vector<MobiusTransformation> transit_;
+	std::vector<int> vertex_segment_;
+	// Vertex of mesh_ of each vertex of sliced_mesh_.
+	std::vector<int> original_vertex_;
 	
 	int n_cones_;
 
 	double max_error = 1e-4;
 
+	// Lengths, angles and cotangent weights of the sliced mesh.
+	GeometryCache geometry_;
+
+	// Flat data of the LBFGS energy, see BuildEnergyData.
+	// Edge e joins edge_vertex_[2e] and edge_vertex_[2e + 1], the outgoing halfedges of
+	// vertex v are vertex_edge_[vertex_edge_offset_[v] ...] encoded as 2e + side.
+	std::vector<int> edge_vertex_;
+	std::vector<double> edge_weight_;
+	std::vector<int> vertex_edge_offset_;
+	std::vector<int> vertex_edge_;
+	// End point coordinates x0, y0, x1, y1 of all edges, one array after the other,
+	// for the batch kernels of HyperbolicGeometry.
+	std::vector<double> edge_coords_;
+	std::vector<double> edge_distance_;
+	std::vector<double> edge_energy_;
+	// Gradient of the squared distance of each edge w.r.t. both end points, laid out as edge_coords_.
+	std::vector<double> edge_gradient_;
+	// Normalized coordinates of the last evaluation.
+	Eigen::VectorXd uv_;
+
+	// Variables of all minimizers, two per variable vertex. Cones are fixed (-1).
+	// A boundary vertex set by Normalize shares the variable of its equivalent vertex
+	// and follows it through the segment isometry, variable_copy_ is that vertex or -1.
+	std::vector<int> vertex_variable_;
+	std::vector<int> vertex_master_;
+	std::vector<int> variable_vertex_;
+	std::vector<int> variable_copy_;
+	int newton_iterations_ = 100;
+	int riemannian_iterations_ = 2000;
+	// Riemannian descent stops at this fraction of the tolerance of the other minimizers.
+	// Gradient descent converges linearly, at the gradient norm where LBFGS stops it is still
+	// short of the LBFGS energy (23.4697 vs 23.4688 on bunny_sphere), a tenth reaches it.
+	double riemannian_error_factor_ = 0.1;
+	// Correction pairs and iterations of the preconditioned LBFGS.
+	int lbfgs_memory_ = 6;
+	int lbfgs_iterations_ = 2000;
+
+	// The multilevel mode coarsens the sliced mesh down to about this many vertices,
+	// solves on levels with at least multilevel_ratio_ times the vertices of the last
+	// solved level, and stops on coarse levels at gradient multilevel_error_.
+	int multilevel_min_vertices_ = 1000;
+	double multilevel_ratio_ = 4;
+	double multilevel_error_ = 1e-3;
+
+	// Wall time of each stage of the last Compute.
+	StageTimer timer_;
+
+	HyperbolicIterationCallback iteration_callback_;
+	HyperbolicSolutionCache *solution_cache_ = nullptr;
+	std::chrono::steady_clock::time_point start_time_;
+	int level_ = 0;
+	int iteration_ = 0;
+
 protected:
 
 	void InitOrbifold();
 	
-	double CosineLaw(double a, double b, double c);
 	double AngleCosineLaw(double a, double b, double c);
-	void ComputeCornerAngles();
+	// Build geometry_, negative cotangent weights are replaced by 0.01.
 	void ComputeHalfedgeWeights();
 	
 	void InitiateBoundaryData();
 	void InitMap();
 
 	void ComputeEdgeLength();
-	double ComputeGradient();
-	OpenMesh::Vec2d ComputeGradientOfDistance2(Complex src, Complex dst);
-	OpenMesh::Vec2d ComputeGradient(OpenMesh::VertexHandle v);
 	
-	double ComputeEnergy();
 	Eigen::VectorXd GetCoordsVector();
-	Eigen::VectorXd GetGradientVector();
 	void SetCoords(const Eigen::VectorXd &uv_vector);
-	double OptimizationLoop(double step_length, double error);
 	
 	// Normalize boundary such that it satisfies orbifold requirement.
 	void Normalize();
+
+	// Edge arrays for the energy, built once per Compute.
+	void BuildEnergyData();
+	// Normalize on a coordinate vector (u0, v0, u1, v1, ...).
+	void Normalize(Eigen::VectorXd &uv);
+	// Distances and energies of all edges at the coordinates uv, and the gradients if asked,
+	// in blocks of EDGE_BLOCK edges.
+	void EvaluateEdges(const Eigen::VectorXd &uv, bool gradient);
+	// Energy of the coordinates uv.
+	double CoordsEnergy(const Eigen::VectorXd &uv);
+	// Energy and gradient at the variables y in one pass, every edge distance is evaluated once.
+	// Infinite if a vertex leaves the disk.
+	double EnergyAndGradient(const Eigen::VectorXd &y, Eigen::VectorXd &grad);
+	// Energy only, for rejected line search steps.
+	double Energy(const Eigen::VectorXd &y);
+
+	// Reduced variables of all minimizers.
+	void BuildVariables();
+	// Variables of normalized coordinates.
+	Eigen::VectorXd ReduceVariables(const Eigen::VectorXd &uv);
+	// Coordinates of all vertices from the variables, false if a vertex leaves the disk.
+	bool ExpandVariables(const Eigen::VectorXd &y, Eigen::VectorXd &uv);
+	// Coordinates of the result y of a minimizer in uv_, uv_start (the coordinates it started
+	// from) if a vertex leaves the disk.
+	void ExpandResult(const Eigen::VectorXd &y, const Eigen::VectorXd &uv_start);
+	// Projected Newton iterations from uv_, stops at the relative gradient norm error.
+	// Returns the number of iterations.
+	int NewtonSolve(double error);
+	// Riemannian gradient descent from uv_, returns the number of iterations. Every variable
+	// vertex moves along the geodesic of its negative Riemannian gradient, so it stays in the disk.
+	// Steps are Barzilai-Borwein steps, halved until the energy decreases enough.
+	// Stops at riemannian_error_factor_ times the relative gradient norm error.
+	int RiemannianSolve(double error);
+	// LBFGS from uv_ with the inverse of PreconditionerMatrix as the initial inverse Hessian,
+	// stops at the relative gradient norm error. Returns the number of iterations.
+	int PreconditionedLBFGSSolve(double error);
+	// Cotangent Laplacian of the variable vertices, each edge weighted by the conformal factors
+	// of the disk at its end points, 8 / ((1 - |p0|^2)(1 - |p1|^2)), the Hessian of the energy
+	// for short edges. It acts on u and v alike, a copy enters with the derivative of its isometry.
+	Eigen::SparseMatrix<double> PreconditionerMatrix();
+	// Value, gradient and projected (positive semidefinite) Hessian of w * d(p0, p1)^2 w.r.t. (p0, p1).
+	static double EdgeEnergyHessian(const Eigen::Vector2d &p0, const Eigen::Vector2d &p1, double w, Eigen::Vector4d &g, Eigen::Matrix4d &H);
+
+	// Minimize the energy on sliced_mesh_ from its normalized coordinates, the result is in uv_.
+	// LBFGS stops at the relative gradient norm error.
+	void Minimize(int mode, double error);
+	// Solve on a hierarchy of sliced_mesh_ from the coarsest level, each level starts
+	// from the prolongated solution of the coarser one.
+	void SolveMultilevel(int mode);
+
+	// Initial map from the closest cached solution, false if there is none. The copies of an
+	// input vertex cut in the cached solution are chosen to be continuous over the sliced mesh.
+	// If the marker differs, the harmonic initial map is used when its energy is lower.
+	bool WarmStart(const HyperbolicSolutionKey &key);
+
+	// Count the iteration and pass it to the callback, false if the run should stop.
+	bool ReportIteration(double energy, double gradient_norm, double step, int evaluations);
+
+	// Objective of LBFGS, with the energy only path and the iteration hook used by EnergyFirstLineSearch.
+	struct Objective {
+		HyperbolicOrbifoldSolver &solver;
+		double operator()(const Eigen::VectorXd &x, Eigen::VectorXd &grad) { return solver.EnergyAndGradient(x, grad); }
+		double Energy(const Eigen::VectorXd &x) { return solver.Energy(x); }
+		bool Iteration(double fx, const Eigen::VectorXd &grad, double step, int evaluations) {
+			return !solver.iteration_callback_ || solver.ReportIteration(fx, grad.norm(), step, evaluations);
+		}
+	};
 };
 
 #endif // !HYPERBOLIC_ORBIFOLD_SOLVER_H_
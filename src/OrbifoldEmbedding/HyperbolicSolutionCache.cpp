@@ -0,0 +1,103 @@
+#include "HyperbolicSolutionCache.h"
+#include <algorithm>
+
+// 64 bit FNV-1a.
+static void HashBytes(uint64_t &hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+HyperbolicSolutionCache::HyperbolicSolutionCache(int capacity)
+	:capacity_(capacity)
+{
+
+}
+
+HyperbolicSolutionKey HyperbolicSolutionCache::Key(SurfaceMesh & mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::EPropHandleT<bool> slice_flag, int mode)
+{
+	using namespace OpenMesh;
+	HyperbolicSolutionKey key;
+	key.connectivity = key.geometry = 14695981039346656037ull;
+	key.mode = mode;
+
+	int n_vertices = mesh.n_vertices();
+	HashBytes(key.connectivity, &n_vertices, sizeof(int));
+	for (auto fiter = mesh.faces_begin(); fiter != mesh.faces_end(); ++fiter) {
+		for (auto fviter = mesh.fv_iter(*fiter); fviter.is_valid(); ++fviter) {
+			int idx = (*fviter).idx();
+			HashBytes(key.connectivity, &idx, sizeof(int));
+		}
+	}
+	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
+		VertexHandle v = *viter;
+		Vec3d p = mesh.point(v);
+		HashBytes(key.geometry, p.data(), 3 * sizeof(double));
+		if (mesh.property(cone_flag, v))
+			key.cones.push_back(v.idx());
+	}
+	for (auto eiter = mesh.edges_begin(); eiter != mesh.edges_end(); ++eiter) {
+		if (mesh.property(slice_flag, *eiter))
+			key.cut_edges.push_back((*eiter).idx());
+	}
+	return key;
+}
+
+int HyperbolicSolutionCache::MarkerDistance(const HyperbolicSolutionKey & a, const HyperbolicSolutionKey & b)
+{
+	std::vector<int> diff;
+	std::set_symmetric_difference(a.cones.begin(), a.cones.end(), b.cones.begin(), b.cones.end(), std::back_inserter(diff));
+	int distance = diff.size();
+	diff.clear();
+	std::set_symmetric_difference(a.cut_edges.begin(), a.cut_edges.end(), b.cut_edges.begin(), b.cut_edges.end(), std::back_inserter(diff));
+	return distance + diff.size();
+}
+
+const HyperbolicSolution * HyperbolicSolutionCache::Find(const HyperbolicSolutionKey & key)
+{
+	for (auto it = solutions_.begin(); it != solutions_.end(); ++it) {
+		const HyperbolicSolutionKey &k = it->key;
+		if (k.connectivity == key.connectivity && k.geometry == key.geometry && k.mode == key.mode &&
+			k.cones == key.cones && k.cut_edges == key.cut_edges) {
+			solutions_.splice(solutions_.begin(), solutions_, it);
+			return &solutions_.front();
+		}
+	}
+	return nullptr;
+}
+
+const HyperbolicSolution * HyperbolicSolutionCache::Closest(const HyperbolicSolutionKey & key)
+{
+	auto closest = solutions_.end();
+	int closest_distance = 0;
+	for (auto it = solutions_.begin(); it != solutions_.end(); ++it) {
+		if (it->key.connectivity != key.connectivity) continue;
+		// The layout of the cones depends on their number.
+		if (it->key.cones.size() != key.cones.size()) continue;
+		int distance = MarkerDistance(it->key, key);
+		if (closest == solutions_.end() || distance < closest_distance) {
+			closest = it;
+			closest_distance = distance;
+		}
+	}
+	if (closest == solutions_.end())
+		return nullptr;
+	solutions_.splice(solutions_.begin(), solutions_, closest);
+	return &solutions_.front();
+}
+
+void HyperbolicSolutionCache::Insert(const HyperbolicSolutionKey & key, const SurfaceMesh & sliced_mesh, const std::vector<int>& original_vertex, const std::vector<OpenMesh::VertexHandle>& cone_vts)
+{
+	if (capacity_ <= 0) return;
+	HyperbolicSolution solution;
+	solution.key = key;
+	solution.sliced_mesh = sliced_mesh;
+	solution.original_vertex = original_vertex;
+	solution.cone_vts = cone_vts;
+	solutions_.push_front(solution);
+	while (solutions_.size() > capacity_)
+		solutions_.pop_back();
+}
@@ -0,0 +1,52 @@
+#ifndef HYPERBOLIC_SOLUTION_CACHE_H_
+#define HYPERBOLIC_SOLUTION_CACHE_H_
+
+#include <MeshDefinition.h>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+// Identifies a solve: hashes of the input mesh and its marker as sorted index lists.
+struct HyperbolicSolutionKey {
+	uint64_t connectivity;
+	uint64_t geometry;
+	std::vector<int> cones;
+	std::vector<int> cut_edges;
+	int mode;
+};
+
+// A solved sliced mesh with its uvs, and the input vertex of each of its vertices.
+struct HyperbolicSolution {
+	HyperbolicSolutionKey key;
+	SurfaceMesh sliced_mesh;
+	std::vector<int> original_vertex;
+	std::vector<OpenMesh::VertexHandle> cone_vts;
+};
+
+// This class keeps the last solutions of HyperbolicOrbifoldSolver, so that solving the
+// same mesh again after a marker or geometry edit can start from a previous solution.
+// The least recently used solution is dropped beyond the capacity.
+class HyperbolicSolutionCache {
+public:
+	HyperbolicSolutionCache(int capacity = 8);
+
+	static HyperbolicSolutionKey Key(SurfaceMesh &mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::EPropHandleT<bool> slice_flag, int mode);
+	// Number of cones and cut edges in only one of the markers.
+	static int MarkerDistance(const HyperbolicSolutionKey &a, const HyperbolicSolutionKey &b);
+
+	// Solution of the same mesh, marker and mode, nullptr if there is none.
+	const HyperbolicSolution *Find(const HyperbolicSolutionKey &key);
+	// Solution of a mesh with the same connectivity and the closest marker, nullptr if there is none.
+	const HyperbolicSolution *Closest(const HyperbolicSolutionKey &key);
+	void Insert(const HyperbolicSolutionKey &key, const SurfaceMesh &sliced_mesh, const std::vector<int> &original_vertex, const std::vector<OpenMesh::VertexHandle> &cone_vts);
+
+	void Clear() { solutions_.clear(); }
+	int Size() const { return solutions_.size(); }
+
+protected:
+	int capacity_;
+	// Most recently used first.
+	std::list<HyperbolicSolution> solutions_;
+};
+
+#endif // !HYPERBOLIC_SOLUTION_CACHE_H_
@@ -18,12 +18,12 @@ void OrbifoldInitializer::Initiate(SurfaceMesh &sliced_mesh, OpenMesh::VPropHand
 	
 }
 
-void OrbifoldInitializer::ComputeEuclideanTransformations(SurfaceMesh & sliced_mesh, OpenMesh::VPropHandleT<Eigen::Matrix3d>& vtx_transit)
+void OrbifoldInitializer::ComputeEuclideanTransformations(SurfaceMesh & sliced_mesh, std::vector<RigidTransformation>& transit, std::vector<int>& vertex_segment)
 {
-	if (!vtx_transit.is_valid())
-		sliced_mesh.add_property(vtx_transit);
 	using namespace OpenMesh;
 	InitiateEConeCoords(sliced_mesh);
+	IndexSegments(sliced_mesh, vertex_segment);
+	transit.clear();
 
 	for (auto it = segments_vts_.begin(); it != segments_vts_.end(); ++it) {
 		auto seg = *it;
@@ -39,25 +39,19 @@ void OrbifoldInitializer::ComputeEuclideanTransformations(SurfaceMesh & sliced_m
 		Complex s1(sliced_mesh.texcoord2D(vs1)[0], sliced_mesh.texcoord2D(vs1)[1]);
 		Complex t0(sliced_mesh.texcoord2D(vt0)[0], sliced_mesh.texcoord2D(vt0)[1]);
 		Complex t1(sliced_mesh.texcoord2D(vt1)[0], sliced_mesh.texcoord2D(vt1)[1]);
-		Eigen::MatrixXd T = ComputeHomogeousRigidTransformation(s0, s1, t0, t1);
-		std::cout << T << std::endl << std::endl;
-		for (auto viter = seg.begin(); viter != seg.end(); ++viter) {
-			VertexHandle v = *viter;
-			if (sliced_mesh.data(v).is_singularity()) continue;
-			sliced_mesh.property(vtx_transit, v) = T;
-		}
+		RigidTransformation T = ComputeRigidTransformation2D(s0, s1, t0, t1);
+		std::cout << T.RotationMatrix() << std::endl << T.Translation().transpose() << std::endl << std::endl;
+		transit.push_back(T);
 	}
 	
 }
 
-void OrbifoldInitializer::ComputeHyperbolicTransformations(SurfaceMesh & sliced_mesh, OpenMesh::VPropHandleT<std::function<Complex(Complex const)>>& vtx_transit)
+void OrbifoldInitializer::ComputeHyperbolicTransformations(SurfaceMesh & sliced_mesh, std::vector<MobiusTransformation>& transit, std::vector<int>& vertex_segment)
 {
 	using namespace OpenMesh;
-	SurfaceMesh &mesh = sliced_mesh;
-	if (!vtx_transit.is_valid())
-		sliced_mesh.add_property(vtx_transit);
-
 	InitiateHConeCoords(sliced_mesh);
+	IndexSegments(sliced_mesh, vertex_segment);
+	transit.clear();
 	
 	for (auto it = segments_vts_.begin(); it != segments_vts_.end(); ++it) {
 		auto seg = *it;
@@ -75,12 +69,20 @@ void OrbifoldInitializer::ComputeHyperbolicTransformations(SurfaceMesh & sliced_
 		Complex t1(sliced_mesh.texcoord2D(vt1)[0], sliced_mesh.texcoord2D(vt1)[1]);
 	
 
-		auto transformation = ComputeMobiusTransformation(s0, s1, t0, t1);
+		MobiusTransformation transformation = ComputeMobiusMatrix(s0, s1, t0, t1);
 		assert(abs(transformation(s1) - t1) < 1e-6);
+		transit.push_back(transformation);
+	}
+}
 
-		for (auto vit = seg.begin(); vit != seg.end(); ++vit) {
-			if(!mesh.data(*vit).is_singularity())
-				mesh.property(vtx_transit, *vit) = transformation;
+void OrbifoldInitializer::IndexSegments(SurfaceMesh & sliced_mesh, std::vector<int>& vertex_segment)
+{
+	using namespace OpenMesh;
+	vertex_segment.assign(sliced_mesh.n_vertices(), -1);
+	for (int i = 0; i < segments_vts_.size(); ++i) {
+		for (auto vit = segments_vts_[i].begin(); vit != segments_vts_[i].end(); ++vit) {
+			if (!sliced_mesh.data(*vit).is_singularity())
+				vertex_segment[(*vit).idx()] = i;
 		}
 	}
 }
@@ -170,17 +172,20 @@ void OrbifoldInitializer::CutMesh(SurfaceMesh & sliced_mesh)
 	slicer.SliceAccordingToWedge(sliced_mesh);
 
 
+	original_vertex_.assign(sliced_mesh.n_vertices(), -1);
 	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
 		VertexHandle v = *viter;
-		auto verts = slicer.SplitTo(v);
-		if (verts.size() == 2) {
-			sliced_mesh.data(verts[0]).set_equivalent_vertex(verts[1]);
-			sliced_mesh.data(verts[1]).set_equivalent_vertex(verts[0]);
+		int n_splits = slicer.NumSplits(v);
+		for (int i = 0; i < n_splits; ++i)
+			original_vertex_[slicer.SplitTo(v, i).idx()] = v.idx();
+		if (n_splits == 2) {
+			sliced_mesh.data(slicer.SplitTo(v, 0)).set_equivalent_vertex(slicer.SplitTo(v, 1));
+			sliced_mesh.data(slicer.SplitTo(v, 1)).set_equivalent_vertex(slicer.SplitTo(v, 0));
 		}
 		if (mesh.property(cone_flag_, v)) {
-			for (auto it = verts.begin(); it != verts.end(); ++it) {
-				sliced_mesh.data(*it).set_singularity(true);
-				sliced_mesh.data(*it).set_angle_sum(mesh.property(cone_angle_, v) / verts.size());
+			for (int i = 0; i < n_splits; ++i) {
+				sliced_mesh.data(slicer.SplitTo(v, i)).set_singularity(true);
+				sliced_mesh.data(slicer.SplitTo(v, i)).set_angle_sum(mesh.property(cone_angle_, v) / n_splits);
 			}
 		}
 	}
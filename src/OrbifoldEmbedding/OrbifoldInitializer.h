@@ -29,20 +29,25 @@ public:
 	OrbifoldInitializer(SurfaceMesh &mesh);
 	void Initiate(SurfaceMesh &sliced_mesh, OpenMesh::VPropHandleT<bool> cone_flag, OpenMesh::VPropHandleT<double> cone_angle, OpenMesh::EPropHandleT<bool> slice_flag);
 	
-	// Compute Isometries needed for orbifold requirements.
-	// Euclidean isometries are stored using homogenous matrx.
-	// Hyperbolic isometries are stored using functions.
-	void ComputeEuclideanTransformations(SurfaceMesh &sliced_mesh, OpenMesh::VPropHandleT<Eigen::Matrix3d> &vtx_transit);
-	void ComputeHyperbolicTransformations(SurfaceMesh &sliced_mesh, OpenMesh::VPropHandleT<std::function<Complex(Complex const)>> &vtx_transit);
+	// Compute Isometries needed for orbifold requirements, one per boundary segment.
+	// transit[i] maps segment i onto its equivalent segment, vertex_segment gives the
+	// segment of each boundary vertex (-1 for cones and interior vertices).
+	// Euclidean isometries are rotations plus translations, hyperbolic ones are Mobius matrices.
+	void ComputeEuclideanTransformations(SurfaceMesh &sliced_mesh, std::vector<RigidTransformation> &transit, std::vector<int> &vertex_segment);
+	void ComputeHyperbolicTransformations(SurfaceMesh &sliced_mesh, std::vector<MobiusTransformation> &transit, std::vector<int> &vertex_segment);
 
 	std::vector<OpenMesh::VertexHandle> GetConeVertices() { return cone_vertices_; }
 
 	std::vector<std::vector<OpenMesh::VertexHandle>> GetSegments() { return segments_vts_; }
+
+	// Vertex of the input mesh of each vertex of the sliced mesh.
+	std::vector<int> GetOriginalVertices() { return original_vertex_; }
 	
 protected:
 	SurfaceMesh &mesh_;
 	std::vector<OpenMesh::VertexHandle> cone_vertices_;
 	std::vector<std::vector<OpenMesh::VertexHandle>> segments_vts_;
+	std::vector<int> original_vertex_;
 
 	OpenMesh::VPropHandleT<bool> cone_flag_;
 	OpenMesh::VPropHandleT<double> cone_angle_;
@@ -55,6 +60,9 @@ protected:
 	// Cut the boundary into segments according to cones.
 	void CutBoundaryToSegments(SurfaceMesh &sliced_mesh);
 
+	// Segment of each non cone boundary vertex, -1 elsewhere.
+	void IndexSegments(SurfaceMesh &sliced_mesh, std::vector<int> &vertex_segment);
+
 	// Initiate the coordinates of cones.
 	void InitiateEConeCoords(SurfaceMesh &sliced_mesh);
 	void InitiateEConeCoordsType1(SurfaceMesh &sliced_mesh);
@@ -0,0 +1,77 @@
+#include "CotangentKernel.h"
+#include "CpuFeatures.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COTANGENT_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+// Lower bound of 16 * area^2, so that degenerate triangles give large but finite cotangents.
+static const double kMinSquaredArea = 1e-300;
+
+static void ComputeCotangentsScalar(const double *a, const double *b, const double *c, double *cot_a, double *cot_b, double *cot_c, int begin, int end)
+{
+	for (int i = begin; i < end; ++i) {
+		double a2 = a[i] * a[i];
+		double b2 = b[i] * b[i];
+		double c2 = c[i] * c[i];
+		// Heron's formula, 16 * area^2.
+		double s = (a[i] + b[i] + c[i]) * (b[i] + c[i] - a[i]) * (a[i] - b[i] + c[i]) * (a[i] + b[i] - c[i]);
+		if (!(s > kMinSquaredArea))
+			s = kMinSquaredArea;
+		double inv = 1. / std::sqrt(s);
+		cot_a[i] = (b2 + c2 - a2) * inv;
+		cot_b[i] = (c2 + a2 - b2) * inv;
+		cot_c[i] = (a2 + b2 - c2) * inv;
+	}
+}
+
+#ifdef COTANGENT_KERNEL_X86
+AVX2_TARGET static void ComputeCotangentsAVX2(const double *a, const double *b, const double *c, double *cot_a, double *cot_b, double *cot_c, int n)
+{
+	const __m256d min_s = _mm256_set1_pd(kMinSquaredArea);
+	const __m256d one = _mm256_set1_pd(1.);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d va = _mm256_loadu_pd(a + i);
+		__m256d vb = _mm256_loadu_pd(b + i);
+		__m256d vc = _mm256_loadu_pd(c + i);
+		__m256d a2 = _mm256_mul_pd(va, va);
+		__m256d b2 = _mm256_mul_pd(vb, vb);
+		__m256d c2 = _mm256_mul_pd(vc, vc);
+		__m256d s = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(va, vb), vc), _mm256_sub_pd(_mm256_add_pd(vb, vc), va));
+		s = _mm256_mul_pd(s, _mm256_add_pd(_mm256_sub_pd(va, vb), vc));
+		s = _mm256_mul_pd(s, _mm256_sub_pd(_mm256_add_pd(va, vb), vc));
+		// max(s, min) also maps nan to min, as the scalar path does.
+		s = _mm256_max_pd(s, min_s);
+		__m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(s));
+		_mm256_storeu_pd(cot_a + i, _mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(b2, c2), a2), inv));
+		_mm256_storeu_pd(cot_b + i, _mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(c2, a2), b2), inv));
+		_mm256_storeu_pd(cot_c + i, _mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(a2, b2), c2), inv));
+	}
+	ComputeCotangentsScalar(a, b, c, cot_a, cot_b, cot_c, i, n);
+}
+#endif
+
+bool CotangentKernelUsesAVX2()
+{
+	return CpuSupportsAVX2();
+}
+
+void ComputeCotangents(const double *a, const double *b, const double *c, double *cot_a, double *cot_b, double *cot_c, int n)
+{
+#ifdef COTANGENT_KERNEL_X86
+	if (CotangentKernelUsesAVX2()) {
+		ComputeCotangentsAVX2(a, b, c, cot_a, cot_b, cot_c, n);
+		return;
+	}
+#endif
+	ComputeCotangentsScalar(a, b, c, cot_a, cot_b, cot_c, 0, n);
+}
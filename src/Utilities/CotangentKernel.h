@@ -0,0 +1,13 @@
+#ifndef COTANGENT_KERNEL_H_
+#define COTANGENT_KERNEL_H_
+
+// Cotangents of the corners of n triangles from their edge lengths a, b, c.
+// cot_a[i] is the cotangent of the corner opposite to a[i], i.e. (b^2 + c^2 - a^2) / (4 * area).
+// Degenerate triangles get a tiny area instead of zero.
+// The AVX2 path is chosen at runtime when the cpu supports it, otherwise a scalar loop is used.
+void ComputeCotangents(const double *a, const double *b, const double *c, double *cot_a, double *cot_b, double *cot_c, int n);
+
+// Whether ComputeCotangents runs the AVX2 path on this machine.
+bool CotangentKernelUsesAVX2();
+
+#endif // !COTANGENT_KERNEL_H_
@@ -0,0 +1,7 @@
+#ifndef CPU_FEATURES_H_
+#define CPU_FEATURES_H_
+
+// Whether the cpu and the os support AVX2, detected once. False on other architectures.
+bool CpuSupportsAVX2();
+
+#endif // !CPU_FEATURES_H_
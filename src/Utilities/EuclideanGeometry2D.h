@@ -4,11 +4,28 @@
 
 #include <complex>
 #include <iostream>
-#include <Eigen\Core>
+#include <Eigen/Core>
 #include <functional>
 
 typedef std::complex<double> Complex;
 
+// Transformation z -> rotation * z + translation, rigid when |rotation| = 1.
+struct RigidTransformation {
+	Complex rotation;
+	Complex translation;
+
+	Complex operator()(Complex const z) const { return rotation * z + translation; }
+	Eigen::Matrix2d RotationMatrix() const {
+		Eigen::Matrix2d R;
+		R << rotation.real(), -rotation.imag(), rotation.imag(), rotation.real();
+		return R;
+	}
+	Eigen::Vector2d Translation() const { return Eigen::Vector2d(translation.real(), translation.imag()); }
+};
+
+// The transformation mapping s0 to t0 and the direction s1 - s0 to t1 - t0.
+RigidTransformation ComputeRigidTransformation2D(Complex const s0, Complex const s1, Complex const t0, Complex const t1);
+
 std::function<Complex(Complex)> ComputeRigidTransformation(Complex const s0, Complex const s1, Complex const t0, Complex const t1);
 
 Eigen::Matrix3d ComputeHomogeousRigidTransformation(Complex const s0, Complex const s1, Complex const t0, Complex const t1);
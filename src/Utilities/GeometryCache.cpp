@@ -0,0 +1,113 @@
+#include "GeometryCache.h"
+#include "CotangentKernel.h"
+#include <algorithm>
+#include <cmath>
+
+// Number of faces handed to the cotangent kernel at once.
+#define COTANGENT_BATCH 1024
+
+GeometryCache::GeometryCache()
+{
+
+}
+
+void GeometryCache::Build(SurfaceMesh & mesh, const Eigen::VectorXd & edge_length)
+{
+	using namespace OpenMesh;
+	int n_faces = mesh.n_faces();
+	int n_edges = mesh.n_edges();
+	int n_halfedges = mesh.n_halfedges();
+	bool with_length = (edge_length.size() == n_edges);
+
+	face_halfedges_.resize(3 * n_faces);
+	face_vertices_.resize(3 * n_faces);
+	halfedge_edge_.resize(n_halfedges);
+	edge_length_.resize(n_edges);
+	cot_.assign(n_halfedges, 0.);
+	weight_.resize(n_halfedges);
+	angle_.clear();
+
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n_edges; ++i) {
+		EdgeHandle e(i);
+		edge_length_[i] = with_length ? edge_length(i) : mesh.calc_edge_length(e);
+		halfedge_edge_[mesh.halfedge_handle(e, 0).idx()] = i;
+		halfedge_edge_[mesh.halfedge_handle(e, 1).idx()] = i;
+	}
+
+	// Edge lengths of each face as three arrays, l[j] belongs to the j-th halfedge.
+	std::vector<double> l[3], cot[3];
+	for (int j = 0; j < 3; ++j) {
+		l[j].resize(n_faces);
+		cot[j].resize(n_faces);
+	}
+
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n_faces; ++i) {
+		HalfedgeHandle h = mesh.halfedge_handle(FaceHandle(i));
+		for (int j = 0; j < 3; ++j) {
+			face_halfedges_[3 * i + j] = h.idx();
+			face_vertices_[3 * i + j] = mesh.to_vertex_handle(h).idx();
+			l[j][i] = edge_length_[halfedge_edge_[h.idx()]];
+			h = mesh.next_halfedge_handle(h);
+		}
+	}
+
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int start = 0; start < n_faces; start += COTANGENT_BATCH) {
+		int n = std::min(COTANGENT_BATCH, n_faces - start);
+		ComputeCotangents(l[0].data() + start, l[1].data() + start, l[2].data() + start,
+			cot[0].data() + start, cot[1].data() + start, cot[2].data() + start, n);
+	}
+
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n_faces; ++i) {
+		for (int j = 0; j < 3; ++j)
+			cot_[face_halfedges_[3 * i + j]] = cot[j][i];
+	}
+
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n_edges; ++i) {
+		EdgeHandle e(i);
+		int h0 = mesh.halfedge_handle(e, 0).idx();
+		int h1 = mesh.halfedge_handle(e, 1).idx();
+		double weight = 0.5 * (cot_[h0] + cot_[h1]);
+		weight_[h0] = weight;
+		weight_[h1] = weight;
+	}
+}
+
+void GeometryCache::ComputeAngles()
+{
+	// The corner at the to vertex of a halfedge is opposite to the previous halfedge.
+	int n_faces = face_halfedges_.size() / 3;
+	angle_.assign(cot_.size(), 0.);
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n_faces; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			int h = face_halfedges_[3 * i + j];
+			int prev = face_halfedges_[3 * i + (j + 2) % 3];
+			angle_[h] = atan2(1., cot_[prev]);
+		}
+	}
+}
+
+void GeometryCache::ClampNegativeWeights(double value)
+{
+	for (int i = 0; i < weight_.size(); ++i) {
+		if (weight_[i] < 0)
+			weight_[i] = value;
+	}
+}
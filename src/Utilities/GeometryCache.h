@@ -0,0 +1,56 @@
+#ifndef GEOMETRY_CACHE_H_
+#define GEOMETRY_CACHE_H_
+
+#include <MeshDefinition.h>
+#include <Eigen/Core>
+#include <vector>
+
+// This class stores the intrinsic geometry of a triangle mesh in flat arrays
+// indexed by OpenMesh handle indices, so that solvers don't go through mesh traits
+// one handle at a time.
+//		face_halfedges / face_vertices: 3 per face, the corner of halfedge i is at its to vertex,
+//		halfedge_edge: edge of each halfedge,
+//		edge_length: length of each edge,
+//		cot: cotangent of the corner opposite to each halfedge (0 for boundary halfedges),
+//		weight: cotangent weight 0.5 * (cot a + cot b) of each halfedge, same for both halfedges of an edge,
+//		angle: corner angle at the to vertex of each halfedge (0 for boundary halfedges), only after ComputeAngles.
+// Cotangents come from edge lengths directly (see CotangentKernel), no angle is needed for the weights.
+class GeometryCache {
+public:
+	GeometryCache();
+
+	// Gather connectivity and compute lengths, cotangents and weights.
+	// Edge lengths are taken from edge_length if its size matches, else from vertex positions.
+	void Build(SurfaceMesh &mesh, const Eigen::VectorXd &edge_length = Eigen::VectorXd());
+
+	// Corner angles from the cotangents, for angle sums.
+	void ComputeAngles();
+
+	// Replace negative cotangent weights with value.
+	void ClampNegativeWeights(double value);
+
+	double Angle(OpenMesh::HalfedgeHandle h) const { return angle_[h.idx()]; }
+	double Cot(OpenMesh::HalfedgeHandle h) const { return cot_[h.idx()]; }
+	double Weight(OpenMesh::HalfedgeHandle h) const { return weight_[h.idx()]; }
+	double EdgeLength(OpenMesh::EdgeHandle e) const { return edge_length_[e.idx()]; }
+	int Edge(OpenMesh::HalfedgeHandle h) const { return halfedge_edge_[h.idx()]; }
+
+	const std::vector<int> &FaceHalfedges() const { return face_halfedges_; }
+	const std::vector<int> &FaceVertices() const { return face_vertices_; }
+	const std::vector<int> &HalfedgeEdges() const { return halfedge_edge_; }
+	const std::vector<double> &EdgeLengths() const { return edge_length_; }
+	const std::vector<double> &Cots() const { return cot_; }
+	const std::vector<double> &Angles() const { return angle_; }
+	const std::vector<double> &Weights() const { return weight_; }
+
+protected:
+	std::vector<int> face_halfedges_;
+	std::vector<int> face_vertices_;
+	std::vector<int> halfedge_edge_;
+	std::vector<double> edge_length_;
+	std::vector<double> cot_;
+	std::vector<double> weight_;
+	std::vector<double> angle_;
+};
+
+#endif // !GEOMETRY_CACHE_H_
@@ -1,57 +1,158 @@
 #include "HyperbolicGeometry.h"
+#include "CpuFeatures.h"
 #include <assert.h>
+#include <cmath>
 
-std::function<Complex(Complex const)> ComputeMobiusTransformation(Complex const s0, Complex const s1, Complex const t0, Complex const t1)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HYPERBOLIC_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+MobiusTransformation ComputeMobiusMatrix(Complex const s0, Complex const s1, Complex const t0, Complex const t1)
 {
-	auto s0_to_zero = [=](Complex const c)->Complex {
-		return (c - s0) / (Complex(1,0) - std::conj(s0)*c);
-	};
-
-	auto t0_to_zero = [=](Complex const c)->Complex {
-		return (c - t0) / (Complex(1, 0) - std::conj(t0)*c);
-	};
-
-	auto zero_to_t0 = [=](Complex const c)->Complex {
-		return (c + t0) / (Complex(1, 0) + std::conj(t0)*c);
-	};
-
-	Complex new_s1 = s0_to_zero(s1);
-	Complex new_t1 = t0_to_zero(t1);
-	
-	Complex rotation_coeff = new_t1 / new_s1;
-
-	auto result = [=](Complex const c)->Complex {
-		Complex resualt = (c - s0) / (Complex(1, 0) - std::conj(s0)*c);
-		resualt *= rotation_coeff;
-		resualt = (resualt + t0) / (Complex(1, 0) + std::conj(t0)*resualt);
-		return resualt;
-	};
-	auto test = result(s1);
+	Complex one(1, 0);
+	MobiusTransformation s0_to_zero = { one, -s0, -std::conj(s0), one };
+	MobiusTransformation t0_to_zero = { one, -t0, -std::conj(t0), one };
+	MobiusTransformation zero_to_t0 = { one, t0, std::conj(t0), one };
+
+	Complex rotation_coeff = t0_to_zero(t1) / s0_to_zero(s1);
+	MobiusTransformation rotation = { rotation_coeff, Complex(0, 0), Complex(0, 0), one };
+
+	MobiusTransformation result = zero_to_t0.Compose(rotation.Compose(s0_to_zero));
 	assert(std::abs(result(s1) - t1) < 1e-6);
 	return result;
 }
 
+std::function<Complex(Complex const)> ComputeMobiusTransformation(Complex const s0, Complex const s1, Complex const t0, Complex const t1)
+{
+	MobiusTransformation result = ComputeMobiusMatrix(s0, s1, t0, t1);
+	return [=](Complex const c)->Complex { return result(c); };
+}
+
 double HyperbolicDistance(Complex p0, Complex p1)
 {
-	double dist  = acosh(
-		1 + 2 * abs(p0 - p1) * abs(p0 - p1) /
-		((1. - abs(p0) * abs(p0)) * (1 - abs(p1) * abs(p1)))
-	);
+	double x0 = p0.real(), y0 = p0.imag(), x1 = p1.real(), y1 = p1.imag();
+	double dist;
+	HyperbolicDistances(&x0, &y0, &x1, &y1, &dist, 1);
 	return dist;
 }
 
+// gx0 == nullptr for distances only.
+static void HyperbolicKernelScalar(const double *x0, const double *y0, const double *x1, const double *y1,
+	double *distance, double *gx0, double *gy0, double *gx1, double *gy1, int begin, int end)
+{
+	for (int i = begin; i < end; ++i) {
+		double dx = x0[i] - x1[i], dy = y0[i] - y1[i];
+		double q = dx * dx + dy * dy;
+		double inv_s0 = 1. / (1. - x0[i] * x0[i] - y0[i] * y0[i]);
+		double inv_s1 = 1. / (1. - x1[i] * x1[i] - y1[i] * y1[i]);
+		double inv_p = inv_s0 * inv_s1;
+		double t = 2. * q * inv_p;
+		double r = std::sqrt(t * (t + 2.));
+		double d = std::log1p(t + r);
+		distance[i] = d;
+		if (!gx0) continue;
+		// d(d^2)/dp0 = 2 d / sinh(d) * df/dp0 with f = 1 + t, sinh(d) = r and d / r -> 1 as r -> 0.
+		double c = 8. * (r > 0 ? d / r : 1.) * inv_p;
+		double c0 = q * inv_s0, c1 = q * inv_s1;
+		gx0[i] = c * (dx + c0 * x0[i]);
+		gy0[i] = c * (dy + c0 * y0[i]);
+		gx1[i] = c * (c1 * x1[i] - dx);
+		gy1[i] = c * (c1 * y1[i] - dy);
+	}
+}
+
+#ifdef HYPERBOLIC_KERNEL_X86
+AVX2_TARGET static void HyperbolicKernelAVX2(const double *x0, const double *y0, const double *x1, const double *y1,
+	double *distance, double *gx0, double *gy0, double *gx1, double *gy1, int n)
+{
+	const __m256d one = _mm256_set1_pd(1.);
+	const __m256d two = _mm256_set1_pd(2.);
+	const __m256d eight = _mm256_set1_pd(8.);
+	const __m256d zero = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d vx0 = _mm256_loadu_pd(x0 + i), vy0 = _mm256_loadu_pd(y0 + i);
+		__m256d vx1 = _mm256_loadu_pd(x1 + i), vy1 = _mm256_loadu_pd(y1 + i);
+		__m256d dx = _mm256_sub_pd(vx0, vx1), dy = _mm256_sub_pd(vy0, vy1);
+		__m256d q = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+		__m256d inv_s0 = _mm256_div_pd(one, _mm256_sub_pd(_mm256_sub_pd(one, _mm256_mul_pd(vx0, vx0)), _mm256_mul_pd(vy0, vy0)));
+		__m256d inv_s1 = _mm256_div_pd(one, _mm256_sub_pd(_mm256_sub_pd(one, _mm256_mul_pd(vx1, vx1)), _mm256_mul_pd(vy1, vy1)));
+		__m256d inv_p = _mm256_mul_pd(inv_s0, inv_s1);
+		__m256d t = _mm256_mul_pd(_mm256_mul_pd(two, q), inv_p);
+		__m256d r = _mm256_sqrt_pd(_mm256_mul_pd(t, _mm256_add_pd(t, two)));
+
+		// No vector log1p, the four lanes go through the scalar one.
+		alignas(32) double arg[4];
+		_mm256_store_pd(arg, _mm256_add_pd(t, r));
+		for (int k = 0; k < 4; ++k)
+			arg[k] = std::log1p(arg[k]);
+		__m256d d = _mm256_load_pd(arg);
+		_mm256_storeu_pd(distance + i, d);
+		if (!gx0) continue;
+
+		__m256d ratio = _mm256_blendv_pd(one, _mm256_div_pd(d, r), _mm256_cmp_pd(r, zero, _CMP_GT_OQ));
+		__m256d c = _mm256_mul_pd(_mm256_mul_pd(eight, ratio), inv_p);
+		__m256d c0 = _mm256_mul_pd(q, inv_s0), c1 = _mm256_mul_pd(q, inv_s1);
+		_mm256_storeu_pd(gx0 + i, _mm256_mul_pd(c, _mm256_add_pd(dx, _mm256_mul_pd(c0, vx0))));
+		_mm256_storeu_pd(gy0 + i, _mm256_mul_pd(c, _mm256_add_pd(dy, _mm256_mul_pd(c0, vy0))));
+		_mm256_storeu_pd(gx1 + i, _mm256_mul_pd(c, _mm256_sub_pd(_mm256_mul_pd(c1, vx1), dx)));
+		_mm256_storeu_pd(gy1 + i, _mm256_mul_pd(c, _mm256_sub_pd(_mm256_mul_pd(c1, vy1), dy)));
+	}
+	HyperbolicKernelScalar(x0, y0, x1, y1, distance, gx0, gy0, gx1, gy1, i, n);
+}
+#endif
+
+static void HyperbolicKernel(const double *x0, const double *y0, const double *x1, const double *y1,
+	double *distance, double *gx0, double *gy0, double *gx1, double *gy1, int n)
+{
+#ifdef HYPERBOLIC_KERNEL_X86
+	if (n >= 4 && CpuSupportsAVX2()) {
+		HyperbolicKernelAVX2(x0, y0, x1, y1, distance, gx0, gy0, gx1, gy1, n);
+		return;
+	}
+#endif
+	HyperbolicKernelScalar(x0, y0, x1, y1, distance, gx0, gy0, gx1, gy1, 0, n);
+}
+
+void HyperbolicDistances(const double *x0, const double *y0, const double *x1, const double *y1, double *distance, int n)
+{
+	HyperbolicKernel(x0, y0, x1, y1, distance, nullptr, nullptr, nullptr, nullptr, n);
+}
+
+void HyperbolicDistance2Gradients(const double *x0, const double *y0, const double *x1, const double *y1,
+	double *distance, double *gx0, double *gy0, double *gx1, double *gy1, int n)
+{
+	HyperbolicKernel(x0, y0, x1, y1, distance, gx0, gy0, gx1, gy1, n);
+}
+
+Complex ExponentialMap(Complex p, Complex v)
+{
+	// At 0 the metric is twice the Euclidean one, exp_0(w) = tanh(|w|) w / |w|.
+	// The isometry z -> (z + p) / (1 + conj(p) z) has derivative 1 - |p|^2 at 0.
+	// Divisions by a complex are written out, std::complex checks for infinities.
+	Complex w = v / (1. - std::norm(p));
+	double length = std::sqrt(std::norm(w));
+	if (length == 0)
+		return p;
+	Complex z = w * (std::tanh(length) / length);
+	Complex denominator = 1. + std::conj(p) * z;
+	return (z + p) * std::conj(denominator) / std::norm(denominator);
+}
+
 Complex InverseExponentialMap(Complex p0, Complex p1)
 {
-	Circle unit(Complex(0, 0), 1.0);
-	Complex reflection = ReflectByCircle(p0, unit);
-	Circle geodesic_circle = CircleFromPoints(std::vector<Complex>({ p0, p1, reflection }));
-	double tangent_length = pow(1 - abs(p0) * abs(p0),2) / 4;
-	double angle0 = geodesic_circle.PolarAngle(p0);
-	double angle1 = geodesic_circle.PolarAngle(p1);
-	Complex tangent = geodesic_circle.Tangent(p0);
-	if (angle1 < angle0)
-		tangent = -tangent;
-	double dist = HyperbolicDistance(p0, p1);
-	double ratio = pow(1 - pow(abs(p0), 2), 2) / 4.0;
-	return tangent * dist * ratio;
+	// Move p0 to 0, where log_0(z) = atanh(|z|) z / |z|, and scale back by 1 - |p0|^2.
+	Complex denominator = 1. - std::conj(p0) * p1;
+	Complex z = (p1 - p0) * std::conj(denominator) / std::norm(denominator);
+	double length = std::sqrt(std::norm(z));
+	if (length == 0)
+		return Complex(0, 0);
+	return z * ((1. - std::norm(p0)) * std::atanh(length) / length);
 }
@@ -12,11 +12,47 @@ These codes are used to handle geometry on Poincare disk
 */
 
 
+// Mobius transformation z -> (a z + b) / (c z + d), stored as a 2x2 complex matrix.
+struct MobiusTransformation {
+	Complex a, b, c, d;
+
+	Complex operator()(Complex const z) const { return (a * z + b) / (c * z + d); }
+	// Complex derivative at z.
+	Complex Derivative(Complex const z) const { return (a * d - b * c) / ((c * z + d) * (c * z + d)); }
+	Complex SecondDerivative(Complex const z) const { return Complex(-2, 0) * c * (a * d - b * c) / ((c * z + d) * (c * z + d) * (c * z + d)); }
+	// The transformation z -> (*this)(other(z)).
+	MobiusTransformation Compose(MobiusTransformation const &other) const {
+		return { a * other.a + b * other.c, a * other.b + b * other.d, c * other.a + d * other.c, c * other.b + d * other.d };
+	}
+};
+
+// The disk isometry mapping s0 to t0 and the geodesic through s0, s1 to the one through t0, t1.
+MobiusTransformation ComputeMobiusMatrix(Complex const s0, Complex const s1, Complex const t0, Complex const t1);
 
 std::function<Complex(Complex const)> ComputeMobiusTransformation(Complex const s0, Complex const s1, Complex const t0, Complex const t1);
 
 double HyperbolicDistance(Complex p0, Complex p1);
 
+// Batch kernels on n point pairs p0 = (x0[i], y0[i]), p1 = (x1[i], y1[i]) in the disk,
+// given as structure of arrays. With t = 2 |p0 - p1|^2 / ((1 - |p0|^2)(1 - |p1|^2)) the
+// distance is acosh(1 + t) = log1p(t + sqrt(t (t + 2))), which keeps full relative accuracy
+// for close points. Near the boundary the rounding of 1 - |p|^2 dominates: the absolute
+// distance error is about 1e-16 / (1 - |p0|^2) + 1e-16 / (1 - |p1|^2), e.g. 1e-10 at |p| = 1 - 1e-6.
+// The AVX2 path is chosen at runtime when the cpu supports it, log1p is evaluated per lane.
+void HyperbolicDistances(const double *x0, const double *y0, const double *x1, const double *y1, double *distance, int n);
+// Distances and the gradients of the squared distances w.r.t. p0 (gx0, gy0) and p1 (gx1, gy1).
+// Coincident points get a zero gradient.
+void HyperbolicDistance2Gradients(const double *x0, const double *y0, const double *x1, const double *y1,
+	double *distance, double *gx0, double *gy0, double *gx1, double *gy1, int n);
+
+// Exponential map of the disk at p: the end of the geodesic from p with initial velocity v.
+// Tangent vectors are in Euclidean coordinates, v has hyperbolic length 2 |v| / (1 - |p|^2).
+// Closed form through the isometry moving 0 to p, the result stays in the open disk
+// unless that length exceeds about 38 and tanh rounds to 1.
+Complex ExponentialMap(Complex p, Complex v);
+
+// Inverse of ExponentialMap, the velocity at p0 of the geodesic reaching p1 at time 1.
+// Its hyperbolic length is HyperbolicDistance(p0, p1).
 Complex InverseExponentialMap(Complex p0, Complex p1);
 
 #endif // !HYPERBOLIC_GEOEMETRY_H_
@@ -0,0 +1,253 @@
+#include "LaplacianAssembler.h"
+#include <algorithm>
+
+LaplacianAssembler::LaplacianAssembler(SurfaceMesh & mesh, const std::vector<double> &weight, int dim)
+	: mesh_(mesh), weight_(weight), dim_(dim), index_(mesh.n_vertices()), row_type_(mesh.n_vertices(), LAPLACIAN_ROW)
+{
+	for (int i = 0; i < index_.size(); ++i)
+		index_[i] = i;
+}
+
+void LaplacianAssembler::SetIndex(const std::vector<int>& index)
+{
+	index_ = index;
+}
+
+void LaplacianAssembler::SetRowType(OpenMesh::VertexHandle v, RowType type)
+{
+	row_type_[v.idx()] = type;
+}
+
+void LaplacianAssembler::SetBoundaryRowType(RowType type)
+{
+	for (auto viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
+		OpenMesh::VertexHandle v = *viter;
+		if (mesh_.is_boundary(v))
+			row_type_[v.idx()] = type;
+	}
+}
+
+void LaplacianAssembler::Pin(OpenMesh::VertexHandle v)
+{
+	pinned_ = v;
+	row_type_[v.idx()] = IDENTITY_ROW;
+}
+
+void LaplacianAssembler::CountEntries(std::vector<size_t>& offset)
+{
+	using namespace OpenMesh;
+	int n = mesh_.n_vertices();
+	offset.assign(n + 1, 0);
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n; ++i) {
+		VertexHandle v(i);
+		size_t count = 0;
+		if (row_type_[i] == IDENTITY_ROW) {
+			count = 1;
+		}
+		else if (row_type_[i] == LAPLACIAN_ROW) {
+			count = 1;
+			for (auto vohiter = mesh_.voh_iter(v); vohiter.is_valid(); ++vohiter) {
+				if (mesh_.to_vertex_handle(*vohiter) != pinned_)
+					++count;
+			}
+		}
+		offset[i + 1] = count * dim_;
+	}
+	for (int i = 0; i < n; ++i)
+		offset[i + 1] += offset[i];
+}
+
+void LaplacianAssembler::Signature(std::vector<int>& signature)
+{
+	using namespace OpenMesh;
+	int n = mesh_.n_vertices();
+	int n_halfedges = mesh_.n_halfedges();
+	signature.resize(4 + 3 * n + 2 * n_halfedges);
+	int *out = signature.data();
+	*out++ = dim_;
+	*out++ = pinned_.idx();
+	*out++ = n;
+	*out++ = n_halfedges;
+	for (int i = 0; i < n; ++i) {
+		*out++ = index_[i];
+		*out++ = row_type_[i];
+		*out++ = mesh_.halfedge_handle(VertexHandle(i)).idx();
+	}
+	for (int i = 0; i < n_halfedges; ++i) {
+		HalfedgeHandle h(i);
+		*out++ = mesh_.to_vertex_handle(h).idx();
+		*out++ = mesh_.next_halfedge_handle(h).idx();
+	}
+}
+
+void LaplacianAssembler::AppendTriplets(std::vector<Eigen::Triplet<double>>& triplets)
+{
+	using namespace OpenMesh;
+	int n = mesh_.n_vertices();
+
+	// Number of entries of each row, then the offset of each row in the output.
+	std::vector<size_t> offset;
+	CountEntries(offset);
+
+	size_t start = triplets.size();
+	triplets.resize(start + offset[n]);
+	Eigen::Triplet<double> *out = triplets.data() + start;
+
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n; ++i) {
+		VertexHandle v(i);
+		size_t k = offset[i];
+		int row = dim_ * index_[i];
+		if (row_type_[i] == IDENTITY_ROW) {
+			for (int d = 0; d < dim_; ++d)
+				out[k++] = Eigen::Triplet<double>(row + d, row + d, 1.);
+		}
+		else if (row_type_[i] == LAPLACIAN_ROW) {
+			double s_w = 0;
+			for (auto vohiter = mesh_.voh_iter(v); vohiter.is_valid(); ++vohiter) {
+				HalfedgeHandle h = *vohiter;
+				VertexHandle neighbor = mesh_.to_vertex_handle(h);
+				double n_w = weight_[h.idx()];
+				s_w += n_w;
+				if (neighbor == pinned_) continue;
+				int col = dim_ * index_[neighbor.idx()];
+				for (int d = 0; d < dim_; ++d)
+					out[k++] = Eigen::Triplet<double>(row + d, col + d, -n_w);
+			}
+			for (int d = 0; d < dim_; ++d)
+				out[k++] = Eigen::Triplet<double>(row + d, row + d, s_w);
+		}
+	}
+}
+
+void LaplacianAssembler::Assemble(Eigen::SparseMatrix<double>& A)
+{
+	LaplacianPattern pattern;
+	Assemble(A, pattern);
+}
+
+void LaplacianAssembler::BuildPattern(LaplacianPattern & pattern)
+{
+	using namespace OpenMesh;
+	int n = mesh_.n_vertices();
+	int size = dim_ * n;
+	pattern.size = size;
+	Signature(pattern.signature);
+	CountEntries(pattern.offset);
+	const std::vector<size_t> &offset = pattern.offset;
+
+	// Column of every entry.
+	std::vector<int> col(offset[n]);
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n; ++i) {
+		VertexHandle v(i);
+		size_t k = offset[i];
+		int row = dim_ * index_[i];
+		if (row_type_[i] == LAPLACIAN_ROW) {
+			for (auto vohiter = mesh_.voh_iter(v); vohiter.is_valid(); ++vohiter) {
+				VertexHandle neighbor = mesh_.to_vertex_handle(*vohiter);
+				if (neighbor == pinned_) continue;
+				for (int d = 0; d < dim_; ++d)
+					col[k++] = dim_ * index_[neighbor.idx()] + d;
+			}
+		}
+		if (row_type_[i] != EMPTY_ROW) {
+			for (int d = 0; d < dim_; ++d)
+				col[k++] = row + d;
+		}
+	}
+
+	// Visit entries by increasing row, so rows are sorted within each column
+	// and repeated (row, col) entries are adjacent and share one nonzero.
+	std::vector<int> vertex_of_row(n);
+	for (int i = 0; i < n; ++i)
+		vertex_of_row[index_[i]] = i;
+
+	std::vector<int> last(size, -1);
+	pattern.outer.assign(size + 1, 0);
+	for (int r = 0; r < n; ++r) {
+		int i = vertex_of_row[r];
+		for (int d = 0; d < dim_; ++d) {
+			int row = dim_ * r + d;
+			for (size_t k = offset[i] + d; k < offset[i + 1]; k += dim_) {
+				if (last[col[k]] == row) continue;
+				last[col[k]] = row;
+				++pattern.outer[col[k] + 1];
+			}
+		}
+	}
+	for (int c = 0; c < size; ++c)
+		pattern.outer[c + 1] += pattern.outer[c];
+
+	std::vector<int> next(pattern.outer.begin(), pattern.outer.end() - 1);
+	std::fill(last.begin(), last.end(), -1);
+	pattern.inner.resize(pattern.outer[size]);
+	pattern.slot.resize(offset[n]);
+	for (int r = 0; r < n; ++r) {
+		int i = vertex_of_row[r];
+		for (int d = 0; d < dim_; ++d) {
+			int row = dim_ * r + d;
+			for (size_t k = offset[i] + d; k < offset[i + 1]; k += dim_) {
+				int c = col[k];
+				if (last[c] != row) {
+					last[c] = row;
+					pattern.inner[next[c]++] = row;
+				}
+				pattern.slot[k] = next[c] - 1;
+			}
+		}
+	}
+}
+
+void LaplacianAssembler::Assemble(Eigen::SparseMatrix<double>& A, LaplacianPattern & pattern)
+{
+	using namespace OpenMesh;
+	int n = mesh_.n_vertices();
+	std::vector<int> signature;
+	Signature(signature);
+	if (pattern.Empty() || signature != pattern.signature)
+		BuildPattern(pattern);
+
+	int nnz = pattern.inner.size();
+	A.resize(pattern.size, pattern.size);
+	A.resizeNonZeros(nnz);
+	std::copy(pattern.outer.begin(), pattern.outer.end(), A.outerIndexPtr());
+	std::copy(pattern.inner.begin(), pattern.inner.end(), A.innerIndexPtr());
+	double *value = A.valuePtr();
+	std::fill(value, value + nnz, 0.);
+
+	// Every row owns its nonzeros, so rows are refilled in parallel.
+	const std::vector<size_t> &offset = pattern.offset;
+	const std::vector<int> &slot = pattern.slot;
+#ifdef WITH_OPENMP
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < n; ++i) {
+		VertexHandle v(i);
+		size_t k = offset[i];
+		if (row_type_[i] == IDENTITY_ROW) {
+			for (int d = 0; d < dim_; ++d)
+				value[slot[k++]] += 1.;
+		}
+		else if (row_type_[i] == LAPLACIAN_ROW) {
+			double s_w = 0;
+			for (auto vohiter = mesh_.voh_iter(v); vohiter.is_valid(); ++vohiter) {
+				HalfedgeHandle h = *vohiter;
+				double n_w = weight_[h.idx()];
+				s_w += n_w;
+				if (mesh_.to_vertex_handle(h) == pinned_) continue;
+				for (int d = 0; d < dim_; ++d)
+					value[slot[k++]] -= n_w;
+			}
+			for (int d = 0; d < dim_; ++d)
+				value[slot[k++]] += s_w;
+		}
+	}
+}
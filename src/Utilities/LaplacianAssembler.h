@@ -0,0 +1,68 @@
+#ifndef LAPLACIAN_ASSEMBLER_H_
+#define LAPLACIAN_ASSEMBLER_H_
+
+#include <MeshDefinition.h>
+#include <Eigen/Sparse>
+#include <vector>
+
+// Compressed column structure of an assembled operator and the nonzero each entry is
+// written to. It only depends on connectivity, row types and indices, so an operator
+// with new weights can be refilled without sorting triplets again.
+struct LaplacianPattern {
+	int size = 0;
+	std::vector<int> outer;
+	std::vector<int> inner;
+	// First entry of each vertex in slot, entries are ordered as in AppendTriplets.
+	std::vector<size_t> offset;
+	std::vector<int> slot;
+	// Connectivity, row types and indices the pattern was built for, see LaplacianAssembler::Signature.
+	std::vector<int> signature;
+
+	bool Empty() const { return outer.empty(); }
+	void Clear() { *this = LaplacianPattern(); }
+};
+
+// This class assembles cotangent Laplacian operators from halfedge weights (see GeometryCache),
+// i.e. row v has sum of weights on the diagonal and -weight(v->w) on column w.
+// Rows may be replaced by identity rows (Dirichlet vertices) or left empty so that
+// a solver can append its own rows. With dim = 2 every entry is repeated for u and v.
+// Rows are filled in parallel when WITH_OPENMP is defined. Every row writes to its
+// own preallocated range, so the triplets are the same for any number of threads.
+class LaplacianAssembler {
+public:
+	enum RowType { LAPLACIAN_ROW, IDENTITY_ROW, EMPTY_ROW };
+
+	LaplacianAssembler(SurfaceMesh &mesh, const std::vector<double> &weight, int dim = 1);
+
+	// Row and column of each vertex, v.idx() by default.
+	void SetIndex(const std::vector<int> &index);
+	void SetRowType(OpenMesh::VertexHandle v, RowType type);
+	void SetBoundaryRowType(RowType type);
+	// Give v an identity row and remove its column from the other rows.
+	void Pin(OpenMesh::VertexHandle v);
+
+	// Append triplets of all rows, in vertex order.
+	void AppendTriplets(std::vector<Eigen::Triplet<double>> &triplets);
+	// Assemble the (dim * n) x (dim * n) operator.
+	void Assemble(Eigen::SparseMatrix<double> &A);
+	// Same, the pattern is built on first use and only values are written afterwards.
+	// It is rebuilt when connectivity, row types or indices differ from those it was built for.
+	void Assemble(Eigen::SparseMatrix<double> &A, LaplacianPattern &pattern);
+	void BuildPattern(LaplacianPattern &pattern);
+
+protected:
+	SurfaceMesh &mesh_;
+	const std::vector<double> &weight_;
+	int dim_;
+	std::vector<int> index_;
+	std::vector<RowType> row_type_;
+	OpenMesh::VertexHandle pinned_;
+
+	// Offset of the entries of each vertex, dim entries per neighbor and the diagonal last.
+	void CountEntries(std::vector<size_t> &offset);
+	// Everything the pattern depends on: dim, pinned vertex, index and row type of each vertex,
+	// outgoing halfedge of each vertex and to vertex and next halfedge of each halfedge.
+	void Signature(std::vector<int> &signature);
+};
+
+#endif // !LAPLACIAN_ASSEMBLER_H_
@@ -0,0 +1,339 @@
+#include "MeshHierarchy.h"
+#include "GeometryCache.h"
+#include <algorithm>
+#include <cmath>
+
+// Minimal cosine between a face normal before and after a collapse.
+#define HIERARCHY_MIN_NORMAL_COSINE 0.3
+// Minimal TriangleQuality of a face after a collapse, about a 120 degree isosceles triangle.
+#define HIERARCHY_MIN_QUALITY 0.5
+// Maximal number of passes of edge flips on a coarse level.
+#define HIERARCHY_FLIP_SWEEPS 10
+
+// 1 for an equilateral triangle, 0 for a degenerate one.
+static double TriangleQuality(const OpenMesh::Vec3d &a, const OpenMesh::Vec3d &b, const OpenMesh::Vec3d &c)
+{
+	double l2 = (b - a).sqrnorm() + (c - b).sqrnorm() + (a - c).sqrnorm();
+	return l2 > 0 ? 2 * sqrt(3.) * ((b - a) % (c - a)).norm() / l2 : 0;
+}
+
+MeshHierarchy::MeshHierarchy(SurfaceMesh & mesh)
+	:mesh_(mesh)
+{
+
+}
+
+void MeshHierarchy::Build(const std::vector<bool>& keep, int min_vertices, int max_levels)
+{
+	levels_.clear();
+	std::vector<bool> level_keep = keep;
+	while (levels_.size() < max_levels && Mesh(levels_.size()).n_vertices() > min_vertices) {
+		std::unique_ptr<MeshLevel> level(new MeshLevel);
+		if (!Coarsen(Mesh(levels_.size()), level_keep, *level))
+			break;
+		levels_.push_back(std::move(level));
+	}
+}
+
+int MeshHierarchy::FromInput(int level, int v) const
+{
+	for (int i = 0; i < level && v >= 0; ++i)
+		v = levels_[i]->from_fine[v];
+	return v;
+}
+
+void MeshHierarchy::Prolongate(int level, const Eigen::VectorXd & coarse, Eigen::VectorXd & fine, int dim) const
+{
+	const MeshLevel &l = *levels_[level - 1];
+	int n_fine = l.from_fine.size();
+	fine.resize(dim * n_fine);
+	for (int i = 0; i < n_fine; ++i) {
+		if (l.from_fine[i] >= 0)
+			fine.segment(dim * i, dim) = coarse.segment(dim * l.from_fine[i], dim);
+	}
+	for (int k = 0; k < l.removed.size(); ++k) {
+		Eigen::VectorXd value = Eigen::VectorXd::Zero(dim);
+		for (int j = l.stencil_offset[k]; j < l.stencil_offset[k + 1]; ++j)
+			value += l.stencil_weight[j] * coarse.segment(dim * l.stencil_vertex[j], dim);
+		fine.segment(dim * l.removed[k], dim) = value;
+	}
+}
+
+bool MeshHierarchy::Coarsen(SurfaceMesh & fine, std::vector<bool>& keep, MeshLevel & level)
+{
+	using namespace OpenMesh;
+	int n = fine.n_vertices();
+	int n_faces = fine.n_faces();
+
+	GeometryCache geometry;
+	geometry.Build(fine);
+	const std::vector<int> &face_vertices = geometry.FaceVertices();
+	std::vector<int> tri(face_vertices.begin(), face_vertices.end());
+	std::vector<bool> alive(n_faces, true);
+	std::vector<std::vector<int>> vertex_faces(n);
+	for (int f = 0; f < n_faces; ++f) {
+		for (int j = 0; j < 3; ++j)
+			vertex_faces[tri[3 * f + j]].push_back(f);
+	}
+
+	auto ring = [&](int v, std::vector<int> &result) {
+		result.clear();
+		for (int f : vertex_faces[v]) {
+			for (int j = 0; j < 3; ++j) {
+				if (tri[3 * f + j] != v)
+					result.push_back(tri[3 * f + j]);
+			}
+		}
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+	};
+	auto normal = [&](int a, int b, int c) {
+		return (fine.point(VertexHandle(b)) - fine.point(VertexHandle(a))) % (fine.point(VertexHandle(c)) - fine.point(VertexHandle(a)));
+	};
+
+	// A cut vertex is removed together with its copy on the other side of the cut,
+	// other boundary vertices are kept.
+	std::vector<int> twin(n, -1);
+	for (int i = 0; i < n; ++i) {
+		VertexHandle v(i);
+		VertexHandle equiv = fine.data(v).equivalent_vertex();
+		if (fine.is_boundary(v) && equiv.is_valid() && equiv.idx() != i && fine.is_boundary(equiv))
+			twin[i] = equiv.idx();
+	}
+	auto twin_of = [&](int v) { return twin[v] >= 0 ? twin[v] : v; };
+
+	// Shortest incident edge first.
+	std::vector<double> shortest(n, 1e300);
+	for (auto eiter = fine.edges_begin(); eiter != fine.edges_end(); ++eiter) {
+		EdgeHandle e = *eiter;
+		HalfedgeHandle h = fine.halfedge_handle(e, 0);
+		double l = geometry.EdgeLength(e);
+		int v0 = fine.from_vertex_handle(h).idx(), v1 = fine.to_vertex_handle(h).idx();
+		shortest[v0] = std::min(shortest[v0], l);
+		shortest[v1] = std::min(shortest[v1], l);
+	}
+	std::vector<int> order;
+	for (int i = 0; i < n; ++i) {
+		if (keep[i]) continue;
+		if (!fine.is_boundary(VertexHandle(i)) || (twin[i] >= 0 && !keep[twin[i]]))
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return shortest[a] < shortest[b]; });
+
+	std::vector<bool> locked(n, false), removed(n, false);
+	std::vector<int> ring_u, ring_v, common;
+
+	// Quality of the worst triangle after collapsing u into v, 0 if the collapse changes
+	// the topology or flips a face. An unlocked vertex still has its one ring of fine.
+	auto collapse_quality = [&](int u, int v) {
+		ring(u, ring_u);
+		ring(v, ring_v);
+		common.clear();
+		std::set_intersection(ring_u.begin(), ring_u.end(), ring_v.begin(), ring_v.end(), std::back_inserter(common));
+		bool boundary = fine.is_boundary(VertexHandle(u));
+		if (common.size() != (boundary ? 1 : 2)) return 0.;
+		double quality = 1;
+		for (int f : vertex_faces[u]) {
+			int a = tri[3 * f], b = tri[3 * f + 1], c = tri[3 * f + 2];
+			if (a == v || b == v || c == v) continue;
+			auto n_old = normal(a, b, c);
+			a = a == u ? v : a;
+			b = b == u ? v : b;
+			c = c == u ? v : c;
+			auto n_new = normal(a, b, c);
+			double len = n_old.norm() * n_new.norm();
+			if (len <= 0 || (n_old | n_new) < HIERARCHY_MIN_NORMAL_COSINE * len) return 0.;
+			quality = std::min(quality, TriangleQuality(fine.point(VertexHandle(a)), fine.point(VertexHandle(b)), fine.point(VertexHandle(c))));
+		}
+		return quality;
+	};
+	auto collapse = [&](int u, int target) {
+		for (int f : vertex_faces[u]) {
+			int *t = &tri[3 * f];
+			if (t[0] == target || t[1] == target || t[2] == target) {
+				alive[f] = false;
+				for (int j = 0; j < 3; ++j) {
+					if (t[j] == u) continue;
+					auto &faces = vertex_faces[t[j]];
+					faces.erase(std::remove(faces.begin(), faces.end(), f), faces.end());
+				}
+			}
+			else {
+				for (int j = 0; j < 3; ++j) {
+					if (t[j] == u) t[j] = target;
+				}
+				vertex_faces[target].push_back(f);
+			}
+		}
+		vertex_faces[u].clear();
+		removed[u] = true;
+		locked[u] = true;
+		for (auto vviter = fine.vv_iter(VertexHandle(u)); vviter.is_valid(); ++vviter)
+			locked[(*vviter).idx()] = true;
+	};
+	// Interior vertices use the cotangent weights of their one ring, boundary vertices
+	// are interpolated linearly between their boundary neighbors.
+	std::vector<std::pair<int, std::vector<std::pair<int, double>>>> stencils;
+	auto add_stencil = [&](int u) {
+		std::vector<std::pair<int, double>> stencil;
+		double sum = 0;
+		bool boundary = fine.is_boundary(VertexHandle(u));
+		for (auto vohiter = fine.voh_iter(VertexHandle(u)); vohiter.is_valid(); ++vohiter) {
+			HalfedgeHandle h = *vohiter;
+			double w;
+			if (!boundary)
+				w = std::max(geometry.Weight(h), 0.);
+			else if (fine.is_boundary(h) || fine.is_boundary(fine.opposite_halfedge_handle(h)))
+				w = 1. / std::max(geometry.EdgeLength(fine.edge_handle(h)), 1e-12);
+			else
+				continue;
+			stencil.push_back(std::make_pair(fine.to_vertex_handle(h).idx(), w));
+			sum += w;
+		}
+		for (auto &s : stencil)
+			s.second = sum > 0 ? s.second / sum : 1. / stencil.size();
+		stencils.push_back(std::make_pair(u, stencil));
+	};
+
+	for (int u : order) {
+		int u_twin = twin_of(u);
+		if (locked[u] || locked[u_twin]) continue;
+		bool boundary = fine.is_boundary(VertexHandle(u));
+
+		// Target: the neighbor giving the best shaped triangles. A cut vertex moves
+		// along the cut, and its copy to the copy of the target.
+		int target = -1;
+		double target_quality = HIERARCHY_MIN_QUALITY;
+		for (auto vohiter = fine.voh_iter(VertexHandle(u)); vohiter.is_valid(); ++vohiter) {
+			HalfedgeHandle h = *vohiter;
+			int v = fine.to_vertex_handle(h).idx();
+			if (boundary) {
+				if (!fine.is_boundary(h) && !fine.is_boundary(fine.opposite_halfedge_handle(h))) continue;
+				if (twin_of(v) == v) continue;
+				HalfedgeHandle twin_h = fine.find_halfedge(VertexHandle(u_twin), VertexHandle(twin_of(v)));
+				if (!twin_h.is_valid() || (!fine.is_boundary(twin_h) && !fine.is_boundary(fine.opposite_halfedge_handle(twin_h)))) continue;
+			}
+			double quality = collapse_quality(u, v);
+			if (boundary && quality > target_quality)
+				quality = std::min(quality, collapse_quality(u_twin, twin_of(v)));
+			if (quality > target_quality) {
+				target = v;
+				target_quality = quality;
+			}
+		}
+		if (target < 0) continue;
+
+		add_stencil(u);
+		collapse(u, target);
+		if (boundary) {
+			add_stencil(u_twin);
+			collapse(u_twin, twin_of(target));
+		}
+	}
+
+	// Collapses leave obtuse pairs of triangles, flip their shared edge while that makes
+	// the cotangent weight larger (a Delaunay like cleanup). Prolongation only uses the
+	// coarse vertices, so the connectivity is free to change.
+	auto cot = [&](int o, int a, int b) {
+		auto ea = fine.point(VertexHandle(a)) - fine.point(VertexHandle(o));
+		auto eb = fine.point(VertexHandle(b)) - fine.point(VertexHandle(o));
+		double area = (ea % eb).norm();
+		return area > 0 ? (ea | eb) / area : -1e300;
+	};
+	for (auto &faces : vertex_faces)
+		std::sort(faces.begin(), faces.end());
+	// Later passes only visit the faces changed by the previous one.
+	std::vector<int> edge_faces;
+	std::vector<bool> dirty(alive), next_dirty(n_faces);
+	for (int sweep = 0; sweep < HIERARCHY_FLIP_SWEEPS; ++sweep) {
+		int n_flips = 0;
+		std::fill(next_dirty.begin(), next_dirty.end(), false);
+		for (int f1 = 0; f1 < n_faces; ++f1) {
+			if (!dirty[f1] || !alive[f1]) continue;
+			for (int j = 0; j < 3; ++j) {
+				int a = tri[3 * f1 + j], b = tri[3 * f1 + (j + 1) % 3], c = tri[3 * f1 + (j + 2) % 3];
+				// The face across a -> b.
+				int f2 = -1, d = -1;
+				for (int f : vertex_faces[b]) {
+					for (int k = 0; k < 3 && f != f1; ++k) {
+						if (tri[3 * f + k] == b && tri[3 * f + (k + 1) % 3] == a) {
+							f2 = f;
+							d = tri[3 * f + (k + 2) % 3];
+						}
+					}
+				}
+				if (f2 < 0 || c == d) continue;
+				double weight = cot(c, a, b) + cot(d, b, a);
+				if (weight >= 0 || cot(a, d, c) + cot(b, c, d) <= weight) continue;
+				edge_faces.clear();
+				std::set_intersection(vertex_faces[c].begin(), vertex_faces[c].end(), vertex_faces[d].begin(), vertex_faces[d].end(), std::back_inserter(edge_faces));
+				if (!edge_faces.empty()) continue;
+				auto n_old = normal(a, b, c) + normal(b, a, d);
+				auto n1 = normal(a, d, c), n2 = normal(d, b, c);
+				if ((n_old | n1) < HIERARCHY_MIN_NORMAL_COSINE * n_old.norm() * n1.norm() ||
+					(n_old | n2) < HIERARCHY_MIN_NORMAL_COSINE * n_old.norm() * n2.norm()) continue;
+
+				tri[3 * f1] = a; tri[3 * f1 + 1] = d; tri[3 * f1 + 2] = c;
+				tri[3 * f2] = d; tri[3 * f2 + 1] = b; tri[3 * f2 + 2] = c;
+				auto replace = [&](int v, int old_face, int new_face) {
+					auto &faces = vertex_faces[v];
+					faces.erase(std::remove(faces.begin(), faces.end(), old_face), faces.end());
+					if (new_face >= 0) faces.insert(std::lower_bound(faces.begin(), faces.end(), new_face), new_face);
+				};
+				replace(a, f2, -1);
+				replace(b, f1, -1);
+				replace(c, -1, f2);
+				replace(d, -1, f1);
+				next_dirty[f1] = next_dirty[f2] = true;
+				++n_flips;
+				break;
+			}
+		}
+		if (n_flips == 0) break;
+		dirty.swap(next_dirty);
+	}
+
+	if (stencils.size() < 0.05 * n)
+		return false;
+
+	// Coarse mesh with the surviving vertices and faces.
+	SurfaceMesh &coarse = level.mesh;
+	level.from_fine.assign(n, -1);
+	std::vector<bool> coarse_keep;
+	for (int i = 0; i < n; ++i) {
+		if (removed[i]) continue;
+		VertexHandle v = coarse.add_vertex(fine.point(VertexHandle(i)));
+		level.from_fine[i] = v.idx();
+		coarse.data(v) = fine.data(VertexHandle(i));
+		coarse.set_texcoord2D(v, fine.texcoord2D(VertexHandle(i)));
+		coarse_keep.push_back(keep[i]);
+	}
+	for (auto viter = coarse.vertices_begin(); viter != coarse.vertices_end(); ++viter) {
+		VertexHandle v = *viter;
+		VertexHandle equiv = coarse.data(v).equivalent_vertex();
+		if (equiv.is_valid())
+			coarse.data(v).set_equivalent_vertex(VertexHandle(level.from_fine[equiv.idx()]));
+	}
+	for (int f = 0; f < n_faces; ++f) {
+		if (!alive[f]) continue;
+		std::vector<VertexHandle> verts;
+		for (int j = 0; j < 3; ++j)
+			verts.push_back(VertexHandle(level.from_fine[tri[3 * f + j]]));
+		coarse.add_face(verts);
+	}
+
+	level.removed.clear();
+	level.stencil_offset.assign(1, 0);
+	level.stencil_vertex.clear();
+	level.stencil_weight.clear();
+	for (auto &s : stencils) {
+		level.removed.push_back(s.first);
+		for (auto &entry : s.second) {
+			level.stencil_vertex.push_back(level.from_fine[entry.first]);
+			level.stencil_weight.push_back(entry.second);
+		}
+		level.stencil_offset.push_back(level.stencil_vertex.size());
+	}
+	keep.swap(coarse_keep);
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef MESH_HIERARCHY_H_
+#define MESH_HIERARCHY_H_
+
+#include <MeshDefinition.h>
+#include <Eigen/Core>
+#include <memory>
+#include <vector>
+
+// One coarse level of a MeshHierarchy and the map from the next finer level.
+struct MeshLevel {
+	SurfaceMesh mesh;
+	// For each vertex of the finer level, its vertex in this level or -1 if it was removed.
+	std::vector<int> from_fine;
+	// Removed vertices of the finer level are interpolated from their one ring,
+	// stencil_vertex are vertices of this level.
+	std::vector<int> removed;
+	std::vector<int> stencil_offset;
+	std::vector<int> stencil_vertex;
+	std::vector<double> stencil_weight;
+};
+
+// This class builds coarser versions of a triangle mesh by halfedge collapses.
+// Every level removes an independent set of vertices, so the one ring of a removed
+// vertex survives and it is interpolated from it with its cotangent weights.
+// On a sliced mesh the two copies of a cut vertex are removed together along the cut,
+// other boundary vertices and flagged vertices (e.g. cones) are never removed.
+// Vertex data, texture coordinates and equivalent vertices are carried to the coarse meshes.
+class MeshHierarchy {
+public:
+	MeshHierarchy(SurfaceMesh &mesh);
+
+	// Add levels until a level has at most min_vertices vertices, or a level removes
+	// less than 5% of the vertices, or there are max_levels levels.
+	void Build(const std::vector<bool> &keep, int min_vertices, int max_levels = 32);
+
+	// Level 0 is the input mesh, 1 ... NumLevels() are coarser.
+	int NumLevels() const { return levels_.size(); }
+	SurfaceMesh &Mesh(int level) { return level == 0 ? mesh_ : levels_[level - 1]->mesh; }
+	MeshLevel &Level(int level) { return *levels_[level - 1]; }
+
+	// Vertex of level of a vertex of the input mesh, -1 if it was removed.
+	int FromInput(int level, int v) const;
+
+	// Interpolate values (dim per vertex) of level to level - 1.
+	void Prolongate(int level, const Eigen::VectorXd &coarse, Eigen::VectorXd &fine, int dim) const;
+
+protected:
+	SurfaceMesh &mesh_;
+	std::vector<std::unique_ptr<MeshLevel>> levels_;
+
+	// Collapse an independent set of fine, false if too few vertices are removed.
+	bool Coarsen(SurfaceMesh &fine, std::vector<bool> &keep, MeshLevel &level);
+};
+
+#endif // !MESH_HIERARCHY_H_
@@ -1,4 +1,6 @@
 #include "MeshMarker.h"
+#include <fstream>
+#include <iomanip>
 
 void MeshMarker::ResetMarker()
 {
@@ -54,6 +56,26 @@ void MeshMarker::ComputeAndSetSlice(OpenMesh::VertexHandle v0, OpenMesh::VertexH
 
 }
 
+void MeshMarker::ComputeCutGraph()
+{
+	SurfaceMesh &mesh = *p_mesh_;
+	using namespace OpenMesh;
+	std::vector<VertexHandle> cones;
+	for (auto viter = mesh.vertices_begin(); viter != mesh.vertices_end(); ++viter) {
+		if (mesh.property(singularity_, *viter))
+			cones.push_back(*viter);
+	}
+	MeshSlicer slicer(mesh);
+	slicer.FindAndMarkCutGraph(cones);
+	n_edges_ = 0;
+	for (auto eiter = mesh.edges_begin(); eiter != mesh.edges_end(); ++eiter) {
+		EdgeHandle e = *eiter;
+		mesh.property(slice_, e) = slicer.OnCut(e);
+		if (slicer.OnCut(e))
+			++n_edges_;
+	}
+}
+
 // The cone angle is  cone_angle * PI;
 void MeshMarker::SetSingularity(OpenMesh::VertexHandle v, double cone_angle)
 {
@@ -5,6 +5,7 @@
 #include "Dijkstra.h"
 #include <Eigen/Core>
 #include "StringParser.h"
+#include "MeshSlicer.h"
 
 #ifndef PI
 #define PI 3.14159254
@@ -16,6 +17,9 @@ public:
 	void SetObject(SurfaceMesh &mesh) { p_mesh_ = &mesh; };
 	void ResetMarker();
 	void ComputeAndSetSlice(OpenMesh::VertexHandle v0, OpenMesh::VertexHandle v1);
+	// Replace the slices by an automatic cut graph through the cones, see MeshSlicer::FindAndMarkCutGraph.
+	void ComputeCutGraph();
+	int NumSlices() { return n_edges_; }
 	void SetSingularity(OpenMesh::VertexHandle v, double cone_angle);
 	OpenMesh::VPropHandleT<bool> GetSingularityFlag() { return singularity_; }
 	OpenMesh::EPropHandleT<bool> GetSliceFlag() { return slice_; }
@@ -1,24 +1,20 @@
 #include "MeshSlicer.h"
-#include <list>
-#include <map>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
 
 MeshSlicer::MeshSlicer(
 	SurfaceMesh &mesh
 ): mesh_(mesh)
 {
-
-	mesh_.add_property(wedge_);
-	mesh_.add_property(on_cut_);
-	mesh_.add_property(split_to_);
-	mesh_.add_property(convert_to_);
-
+	on_cut_.assign(mesh_.n_edges(), false);
 }
 
 void MeshSlicer::ResetFlags()
 {
-	for (auto eiter = mesh_.edges_begin(); eiter != mesh_.edges_end(); ++eiter) {
-		mesh_.property(on_cut_, *eiter) = false;
-	}
+	on_cut_.assign(mesh_.n_edges(), false);
 }
 
 void MeshSlicer::SliceMeshToDisk(SurfaceMesh &slice_mesh)
@@ -34,12 +30,25 @@ void MeshSlicer::SliceMeshToDisk(SurfaceMesh &slice_mesh)
 
 std::vector<OpenMesh::VertexHandle> MeshSlicer::SplitTo(OpenMesh::VertexHandle v)
 {
-	return mesh_.property(split_to_,v);
+	std::vector<OpenMesh::VertexHandle> verts(NumSplits(v));
+	for (int i = 0; i < verts.size(); ++i)
+		verts[i] = SplitTo(v, i);
+	return verts;
 }
 
 OpenMesh::HalfedgeHandle MeshSlicer::ConvertTo(OpenMesh::HalfedgeHandle h)
 {
-	return mesh_.property(convert_to_, h);
+	return OpenMesh::HalfedgeHandle(convert_to_[h.idx()]);
+}
+
+OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> MeshSlicer::split_to()
+{
+	if (!split_to_.is_valid()) {
+		mesh_.add_property(split_to_);
+		for (auto viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter)
+			mesh_.property(split_to_, *viter) = SplitTo(*viter);
+	}
+	return split_to_;
 }
 
 std::vector<OpenMesh::VertexHandle> MeshSlicer::GetLongestPath()
@@ -50,7 +59,8 @@ std::vector<OpenMesh::VertexHandle> MeshSlicer::GetLongestPath()
 void MeshSlicer::FindAndMarkCutGraphSphere()
 {
 	using namespace OpenMesh;
-	base_point_ = *(mesh_.vertices_begin());
+	if (!base_point_.is_valid())
+		base_point_ = *(mesh_.vertices_begin());
 	OpenMesh::VPropHandleT<double> dist;
 	OpenMesh::VPropHandleT<OpenMesh::VertexHandle> parent;
 	DijkstraShortestDist(mesh_, base_point_, dist, parent);
@@ -78,66 +88,186 @@ void MeshSlicer::FindAndMarkCutGraphSphere()
 	std::reverse(longest_path_vertices.begin(), longest_path_vertices.end());
 	
 	longest_path_ = longest_path_vertices;
-	for (auto eiter = mesh_.edges_begin(); eiter != mesh_.edges_end(); ++eiter) {
-		OpenMesh::EdgeHandle e = *eiter;
-		mesh_.property(on_cut_, e) = false;
-	}
+	ResetFlags();
 	for (int i = 0; i < longest_path_vertices.size() - 1; ++i) {
 		EdgeHandle e = mesh_.edge_handle(mesh_.find_halfedge(longest_path_vertices[i], longest_path_vertices[i+1]));
-		mesh_.property(on_cut_, e) = true;
+		on_cut_[e.idx()] = true;
 	}
 }
 
 void MeshSlicer::FindAndMarkCutGraphNonSphere()
 {
-
+	FindAndMarkCutGraph(std::vector<OpenMesh::VertexHandle>());
 }
 
-void MeshSlicer::ConstructWedge()
+void MeshSlicer::FindAndMarkCutGraph(const std::vector<OpenMesh::VertexHandle> &keep)
 {
 	using namespace OpenMesh;
-	for (auto hiter = mesh_.halfedges_begin(); hiter != mesh_.halfedges_end(); ++hiter) {
-		OpenMesh::HalfedgeHandle h = *hiter;
-		mesh_.property(wedge_, h) = 0;
+	int n_vertices = mesh_.n_vertices();
+	int n_edges = mesh_.n_edges();
+	int n_faces = mesh_.n_faces();
+
+	// Shortest path tree from the first kept vertex, one tree per connected component.
+	std::vector<char> in_tree(n_edges, false);
+	std::vector<double> dist(n_vertices, std::numeric_limits<double>::infinity());
+	std::vector<char> done(n_vertices, false);
+	std::vector<int> roots;
+	for (auto it = keep.begin(); it != keep.end(); ++it)
+		roots.push_back((*it).idx());
+	for (int i = 0; i < n_vertices; ++i)
+		roots.push_back(i);
+	typedef std::pair<double, int> QueueItem;
+	std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+	std::vector<int> parent_edge(n_vertices, -1);
+	for (auto rit = roots.begin(); rit != roots.end(); ++rit) {
+		if (done[*rit]) continue;
+		dist[*rit] = 0;
+		queue.push(QueueItem(0, *rit));
+		while (!queue.empty()) {
+			QueueItem item = queue.top();
+			queue.pop();
+			int v = item.second;
+			if (done[v]) continue;
+			done[v] = true;
+			if (parent_edge[v] >= 0)
+				in_tree[parent_edge[v]] = true;
+			for (SurfaceMesh::VertexOHalfedgeIter vohiter = mesh_.voh_iter(VertexHandle(v)); vohiter.is_valid(); ++vohiter) {
+				HalfedgeHandle h = *vohiter;
+				int u = mesh_.to_vertex_handle(h).idx();
+				EdgeHandle e = mesh_.edge_handle(h);
+				double d = item.first + mesh_.calc_edge_length(e);
+				if (!done[u] && d < dist[u]) {
+					dist[u] = d;
+					parent_edge[u] = e.idx();
+					queue.push(QueueItem(d, u));
+				}
+			}
+		}
 	}
-	for (SurfaceMesh::VertexIter viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
-		VertexHandle v = *viter;
-		std::list<HalfedgeHandle> halfedges_around;
-		for (SurfaceMesh::VertexIHalfedgeCWIter vihiter = mesh_.vih_cwiter(v); vihiter.is_valid(); ++vihiter) {
-			HalfedgeHandle h = *vihiter;
-			if (mesh_.is_boundary(h)) continue;
-			halfedges_around.push_back(h);
+
+	// Spanning tree of the faces by union find, through the edges off the tree first.
+	// With boundaries the tree and the boundaries may enclose faces, only then it crosses the tree.
+	std::vector<int> face_root(n_faces);
+	std::iota(face_root.begin(), face_root.end(), 0);
+	auto find = [&face_root](int f) {
+		while (face_root[f] != f) {
+			face_root[f] = face_root[face_root[f]];
+			f = face_root[f];
 		}
-		for (std::list<HalfedgeHandle>::iterator it = halfedges_around.begin(); it != halfedges_around.end(); ++it) {
-			HalfedgeHandle h = *it;
-			if (mesh_.is_boundary(v)) {
-				if (mesh_.is_boundary(mesh_.opposite_halfedge_handle(h))) {
-					halfedges_around.insert(halfedges_around.end(), halfedges_around.begin(), it);
-					halfedges_around.erase(halfedges_around.begin(), it);
-					break;
-				}
+		return f;
+	};
+	std::vector<char> in_cotree(n_edges, false);
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int i = 0; i < n_edges; ++i) {
+			EdgeHandle e(i);
+			if (mesh_.is_boundary(e) || in_tree[i] != (pass == 1)) continue;
+			int f0 = find(mesh_.face_handle(mesh_.halfedge_handle(e, 0)).idx());
+			int f1 = find(mesh_.face_handle(mesh_.halfedge_handle(e, 1)).idx());
+			if (f0 == f1) continue;
+			face_root[f0] = f1;
+			in_cotree[i] = true;
+		}
+	}
+
+	// The cut is every interior edge the face tree does not cross. Cutting it leaves a disk,
+	// and so does gluing back a dangling branch: prune from the tips, boundary vertices
+	// (two boundary edges) and kept vertices are never tips.
+	ResetFlags();
+	std::vector<int> degree(n_vertices, 0);
+	for (int i = 0; i < n_edges; ++i) {
+		EdgeHandle e(i);
+		on_cut_[i] = !mesh_.is_boundary(e) && !in_cotree[i];
+		if (on_cut_[i] || mesh_.is_boundary(e)) {
+			++degree[mesh_.to_vertex_handle(mesh_.halfedge_handle(e, 0)).idx()];
+			++degree[mesh_.to_vertex_handle(mesh_.halfedge_handle(e, 1)).idx()];
+		}
+	}
+	std::vector<char> kept(n_vertices, false);
+	for (auto it = keep.begin(); it != keep.end(); ++it)
+		kept[(*it).idx()] = true;
+	std::vector<int> tips;
+	for (int i = 0; i < n_vertices; ++i) {
+		if (degree[i] == 1 && !kept[i])
+			tips.push_back(i);
+	}
+	while (!tips.empty()) {
+		VertexHandle v(tips.back());
+		tips.pop_back();
+		if (degree[v.idx()] != 1) continue;
+		for (SurfaceMesh::VertexOHalfedgeIter vohiter = mesh_.voh_iter(v); vohiter.is_valid(); ++vohiter) {
+			HalfedgeHandle h = *vohiter;
+			int e = mesh_.edge_handle(h).idx();
+			if (!on_cut_[e]) continue;
+			on_cut_[e] = false;
+			--degree[v.idx()];
+			int u = mesh_.to_vertex_handle(h).idx();
+			if (--degree[u] == 1 && !kept[u])
+				tips.push_back(u);
+			break;
+		}
+	}
+
+	int n_cut_edges = 0;
+	bool closed = true;
+	for (int i = 0; i < n_edges; ++i) {
+		n_cut_edges += on_cut_[i];
+		if (mesh_.is_boundary(EdgeHandle(i)))
+			closed = false;
+	}
+	if (closed && n_cut_edges == 0) {
+		// At most one kept vertex: start the longest path there.
+		if (!keep.empty())
+			base_point_ = keep.front();
+		FindAndMarkCutGraphSphere();
+	}
+}
+
+void MeshSlicer::ConstructWedge()
+{
+	using namespace OpenMesh;
+	int n_vertices = mesh_.n_vertices();
+	wedge_.assign(mesh_.n_halfedges(), 0);
+#ifdef WITH_OPENMP
+#pragma omp parallel
+#endif
+	{
+		// Interior in-halfedges of a vertex in clockwise order, reused over the vertices.
+		std::vector<HalfedgeHandle> halfedges_around;
+#ifdef WITH_OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (int i = 0; i < n_vertices; ++i) {
+			VertexHandle v(i);
+			halfedges_around.clear();
+			for (SurfaceMesh::VertexIHalfedgeCWIter vihiter = mesh_.vih_cwiter(v); vihiter.is_valid(); ++vihiter) {
+				HalfedgeHandle h = *vihiter;
+				if (mesh_.is_boundary(h)) continue;
+				halfedges_around.push_back(h);
 			}
-			else {
-				if (mesh_.property(on_cut_,mesh_.edge_handle(h))) {
-					halfedges_around.insert(halfedges_around.end(), halfedges_around.begin(), it);
-					halfedges_around.erase(halfedges_around.begin(), it);
+			int n = halfedges_around.size();
+			if (n == 0) continue;
+
+			// The first wedge starts after the boundary, or at a cut edge of an interior vertex.
+			bool boundary = mesh_.is_boundary(v);
+			int first = 0;
+			for (int k = 0; k < n; ++k) {
+				HalfedgeHandle h = halfedges_around[k];
+				if (boundary ? mesh_.is_boundary(mesh_.opposite_halfedge_handle(h)) : on_cut_[mesh_.edge_handle(h).idx()]) {
+					first = k;
 					break;
 				}
 			}
-		}
 
-		/*construct wedge around vertex v*/
-		int w = 0;
-		std::list<HalfedgeHandle>::iterator it = halfedges_around.begin();
-		mesh_.property(wedge_, *it) = 0;
-		++it;
-		for (; it != halfedges_around.end(); ++it) {
-			HalfedgeHandle h = *it;
-			if (mesh_.property(on_cut_, mesh_.edge_handle(h))
-				|| mesh_.is_boundary(mesh_.edge_handle(h))) {
-				w++;
+			/*construct wedge around vertex v*/
+			int w = 0;
+			for (int k = 1; k < n; ++k) {
+				HalfedgeHandle h = halfedges_around[(first + k) % n];
+				EdgeHandle e = mesh_.edge_handle(h);
+				if (on_cut_[e.idx()] || mesh_.is_boundary(e)) {
+					w++;
+				}
+				wedge_[h.idx()] = w;
 			}
-			mesh_.property(wedge_, h) = w;
 		}
 	}
 }
@@ -145,68 +275,85 @@ void MeshSlicer::ConstructWedge()
 void MeshSlicer::SliceAccordingToWedge(SurfaceMesh &new_mesh)
 {
 	using namespace OpenMesh;
-	HPropHandleT<VertexHandle> new_end; // store the new end of an halfedge after being cutted.
-	mesh_.add_property(new_end);
+	int n_vertices = mesh_.n_vertices();
+	int n_faces = mesh_.n_faces();
+	// store the new end of an halfedge after being cutted.
+	std::vector<int> new_end(mesh_.n_halfedges(), -1);
 
-	HPropHandleT<HalfedgeHandle> halfedge_split_to;
-	mesh_.add_property(halfedge_split_to);
-
-	int max_vid = mesh_.n_vertices() - 1;
-
-	for (SurfaceMesh::VertexIter viter = mesh_.vertices_begin(); viter != mesh_.vertices_end(); ++viter) {
-		VertexHandle v = *viter;
-		// triverse around in-halfedges, add new vertices if needed and bind halfedges to their new ends.
-		std::map<int, VertexHandle> whether_new_vert_exists;
-		for (SurfaceMesh::VertexIHalfedgeIter vihiter = mesh_.vih_iter(v); vihiter.is_valid(); ++vihiter) {
-			HalfedgeHandle h = *vihiter;
-			int wedge = mesh_.property(wedge_, h);
-			if (whether_new_vert_exists[wedge].is_valid())
-				mesh_.property(new_end, h) = whether_new_vert_exists[wedge];
-			else {
-				VertexHandle new_vertex = new_mesh.add_vertex(mesh_.point(v));
-				mesh_.property(split_to_, v).push_back(new_vertex);
-				mesh_.property(new_end, h) = new_vertex;
-				whether_new_vert_exists[wedge] = new_vertex;
+	// The copies of a vertex are numbered by the first appearance of their wedges around it.
+	split_offset_.assign(n_vertices + 1, 0);
+#ifdef WITH_OPENMP
+#pragma omp parallel
+#endif
+	{
+		std::vector<int> wedge_rank;
+#ifdef WITH_OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (int i = 0; i < n_vertices; ++i) {
+			VertexHandle v(i);
+			int n_wedges = 0;
+			for (SurfaceMesh::VertexIHalfedgeIter vihiter = mesh_.vih_iter(v); vihiter.is_valid(); ++vihiter) {
+				HalfedgeHandle h = *vihiter;
+				int wedge = wedge_[h.idx()];
+				if (wedge >= wedge_rank.size())
+					wedge_rank.resize(wedge + 1, -1);
+				if (wedge_rank[wedge] < 0)
+					wedge_rank[wedge] = n_wedges++;
+				new_end[h.idx()] = wedge_rank[wedge];
 			}
+			split_offset_[i + 1] = n_wedges;
+			for (SurfaceMesh::VertexIHalfedgeIter vihiter = mesh_.vih_iter(v); vihiter.is_valid(); ++vihiter)
+				wedge_rank[wedge_[(*vihiter).idx()]] = -1;
 		}
 	}
+	// The slicer appends to new_mesh.
+	split_offset_[0] = new_mesh.n_vertices();
+	for (int i = 0; i < n_vertices; ++i)
+		split_offset_[i + 1] += split_offset_[i];
+#ifdef WITH_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < mesh_.n_halfedges(); ++i) {
+		if (new_end[i] >= 0)
+			new_end[i] += split_offset_[mesh_.to_vertex_handle(HalfedgeHandle(i)).idx()];
+	}
+
+	// A cut edge has two copies, other edges one.
+	int n_cut_edges = 0;
+	for (int i = 0; i < on_cut_.size(); ++i)
+		n_cut_edges += on_cut_[i];
+	new_mesh.reserve(split_offset_[n_vertices], new_mesh.n_edges() + mesh_.n_edges() + n_cut_edges, new_mesh.n_faces() + n_faces);
+	for (int i = 0; i < n_vertices; ++i) {
+		Vec3d p = mesh_.point(VertexHandle(i));
+		for (int j = split_offset_[i]; j < split_offset_[i + 1]; ++j)
+			new_mesh.add_vertex(p);
+	}
 
 	/*construct face*/
-	for (SurfaceMesh::FaceIter fiter = mesh_.faces_begin(); fiter != mesh_.faces_end(); ++fiter) {
-		FaceHandle f = *fiter;
-		std::vector<VertexHandle> verts;
-		std::vector<VertexHandle> old_verts;
-		for (SurfaceMesh::FaceHalfedgeIter fhiter = mesh_.fh_iter(f); fhiter.is_valid(); ++fhiter) {
-			HalfedgeHandle h = *fhiter;
-			VertexHandle v = mesh_.to_vertex_handle(h);
-			old_verts.push_back(v);
-			VertexHandle nv = mesh_.property(new_end, h);
-			verts.push_back(nv);
-		}
-		FaceHandle new_f = new_mesh.add_face(verts);
-		for (int i = 0; i < 3; ++i) {
-			HalfedgeHandle he = new_mesh.find_halfedge(verts[i], verts[(i + 1) % 3]);
-			HalfedgeHandle ohe = mesh_.find_halfedge(old_verts[i], old_verts[(i + 1) % 3]);
-			mesh_.property(convert_to_, ohe) = he;
-			EdgeHandle e = new_mesh.edge_handle(he);
-			EdgeHandle oe = mesh_.edge_handle(ohe);
-		}
+	int first_face = new_mesh.n_faces();
+	for (int i = 0; i < n_faces; ++i) {
+		SurfaceMesh::FaceHalfedgeIter fhiter = mesh_.fh_iter(FaceHandle(i));
+		VertexHandle v0(new_end[(*fhiter).idx()]);
+		VertexHandle v1(new_end[(*++fhiter).idx()]);
+		VertexHandle v2(new_end[(*++fhiter).idx()]);
+		new_mesh.add_face(v0, v1, v2);
 	}
-	
 	new_mesh.RequestBoundary();
 
-
-	//for (auto eiter = mesh_.edges_begin(); eiter != mesh_.edges_end(); ++eiter) {
-	//	EdgeHandle e = *eiter;
-	//	HalfedgeHandle h0 = mesh_.halfedge_handle(e, 0);
-	//	HalfedgeHandle h1 = mesh_.halfedge_handle(e, 1);
-	//	HalfedgeHandle new_h0 = mesh_.property(halfedge_split_to, h0);
-	//	HalfedgeHandle new_h1 = mesh_.property(halfedge_split_to, h1);
-	//	if (mesh_.is_boundary(e)) {
-	//		assert(new_h0.is_valid());
-	//		assert(new_h1.is_valid());
-	//	}
-	//	//new_mesh.data(new_h0).set_original_opposition(new_h1);
-	//	//new_mesh.data(new_h1).set_original_opposition(new_h0);
-	//}
-}
\ No newline at end of file
+	// An halfedge of an input face goes to the halfedge of the new face with the same new end.
+	convert_to_.assign(mesh_.n_halfedges(), -1);
+#ifdef WITH_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < n_faces; ++i) {
+		FaceHandle new_f(first_face + i);
+		for (SurfaceMesh::FaceHalfedgeIter fhiter = mesh_.fh_iter(FaceHandle(i)); fhiter.is_valid(); ++fhiter) {
+			HalfedgeHandle h = *fhiter;
+			for (SurfaceMesh::FaceHalfedgeIter new_fhiter = new_mesh.fh_iter(new_f); new_fhiter.is_valid(); ++new_fhiter) {
+				if (new_mesh.to_vertex_handle(*new_fhiter).idx() == new_end[h.idx()])
+					convert_to_[h.idx()] = (*new_fhiter).idx();
+			}
+		}
+	}
+}
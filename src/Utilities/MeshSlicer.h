@@ -6,33 +6,47 @@
 
 // This class is modified from my previous research codes.
 // The algorithm is in Gu's book Computational Conformal Geometry.
+// Wedges, new vertex indices and the split / convert maps are kept in flat arrays indexed
+// by the handles of the input mesh, so slicing adds no property to it.
 class MeshSlicer {
 public:
 	MeshSlicer(SurfaceMesh &mesh);
 	void ResetFlags();
 	void SliceMeshToDisk(SurfaceMesh &sliced_mesh);
 	std::vector<OpenMesh::VertexHandle> SplitTo(OpenMesh::VertexHandle v);
+	// Copies of v in the sliced mesh without building a vector, see SplitTo.
+	int NumSplits(OpenMesh::VertexHandle v) const { return split_offset_[v.idx() + 1] - split_offset_[v.idx()]; }
+	OpenMesh::VertexHandle SplitTo(OpenMesh::VertexHandle v, int i) const { return OpenMesh::VertexHandle(split_offset_[v.idx()] + i); }
 	OpenMesh::HalfedgeHandle ConvertTo(OpenMesh::HalfedgeHandle h);
 	std::vector<OpenMesh::VertexHandle> GetLongestPath();
 	void FindAndMarkCutGraphSphere();
 	void FindAndMarkCutGraphNonSphere();
+	// Tree-cotree cut graph for any genus and number of boundaries: a shortest path tree of
+	// the vertices, a spanning tree of the faces crossing it only where the boundaries force it,
+	// and the other edges pruned of dangling branches. keep (e.g. cones) stays on the cut.
+	// A sphere whose cut prunes to nothing falls back to FindAndMarkCutGraphSphere.
+	void FindAndMarkCutGraph(const std::vector<OpenMesh::VertexHandle> &keep);
 	void ConstructWedge();
 	void SliceAccordingToWedge(SurfaceMesh &sliced_mesh);
-	void AddOnCutEdge(OpenMesh::EdgeHandle e) { mesh_.property(on_cut_, e) = true; }
+	void AddOnCutEdge(OpenMesh::EdgeHandle e) { on_cut_[e.idx()] = true; }
+	bool OnCut(OpenMesh::EdgeHandle e) const { return on_cut_[e.idx()]; }
 
-	OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> split_to() { return split_to_; }
+	// SplitTo as a vertex property of the input mesh, added on the first call.
+	OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> split_to();
 protected:
 
 	SurfaceMesh &mesh_;
 	OpenMesh::VertexHandle base_point_;
-	OpenMesh::HPropHandleT<int> wedge_;
-	OpenMesh::EPropHandleT<bool> on_cut_;
+	// Wedge of each halfedge around its to vertex.
+	std::vector<int> wedge_;
+	std::vector<char> on_cut_;
+	// The copies of vertex v are split_offset_[v] ... split_offset_[v + 1] - 1 in the sliced mesh.
+	std::vector<int> split_offset_;
 	OpenMesh::VPropHandleT<std::vector<OpenMesh::VertexHandle>> split_to_;
 	// one halfedge on the original mesh will appear once and only once on sliced mesh;
-	OpenMesh::HPropHandleT<OpenMesh::HalfedgeHandle> convert_to_;  
+	std::vector<int> convert_to_;
 	std::vector<OpenMesh::VertexHandle> longest_path_;
-	OpenMesh::HPropHandleT<OpenMesh::HalfedgeHandle> original_reflection_;
-	
+
 };
 
 
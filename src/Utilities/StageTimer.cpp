@@ -0,0 +1,39 @@
+#include "StageTimer.h"
+
+void StageTimer::Start(std::string stage)
+{
+	StageIndex(stage);
+	running_[stage] = std::chrono::steady_clock::now();
+}
+
+void StageTimer::Stop(std::string stage)
+{
+	auto it = running_.find(stage);
+	if (it == running_.end()) return;
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - it->second;
+	timings_[StageIndex(stage)].second += elapsed.count();
+	running_.erase(it);
+}
+
+void StageTimer::Reset()
+{
+	timings_.clear();
+	running_.clear();
+}
+
+double StageTimer::Seconds(std::string stage)
+{
+	for (auto it = timings_.begin(); it != timings_.end(); ++it) {
+		if (it->first == stage) return it->second;
+	}
+	return 0.;
+}
+
+int StageTimer::StageIndex(std::string stage)
+{
+	for (int i = 0; i < timings_.size(); ++i) {
+		if (timings_[i].first == stage) return i;
+	}
+	timings_.push_back(std::make_pair(stage, 0.));
+	return timings_.size() - 1;
+}
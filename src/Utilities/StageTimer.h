@@ -0,0 +1,27 @@
+#ifndef STAGE_TIMER_H_
+#define STAGE_TIMER_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+
+// This class accumulates wall time of named stages inside a solver.
+// Stages are reported in the order they first started, in seconds.
+// A stage can be started and stopped many times; its durations are summed.
+class StageTimer {
+public:
+	void Start(std::string stage);
+	void Stop(std::string stage);
+	void Reset();
+	double Seconds(std::string stage);
+	std::vector<std::pair<std::string, double>> Timings() { return timings_; }
+
+protected:
+	std::vector<std::pair<std::string, double>> timings_;
+	std::map<std::string, std::chrono::steady_clock::time_point> running_;
+
+	int StageIndex(std::string stage);
+};
+
+#endif // !STAGE_TIMER_H_
@@ -79,6 +79,7 @@ void OTEViewer::InitMenu()
 			if (ImGui::Button("Hyperbolic Orbifold", ImVec2(-1, 0)))
 			{
 				HyperbolicOrbifoldSolver solver(this->mesh_, marker_.GetSingularityFlag(), marker_.GetSliceFlag());
+				solver.SetSolutionCache(&hyperbolic_cache_);
 				this->sliced_mesh_ = solver.Compute();
 				this->cone_vts_ = solver.ConeVertices();
 				euclidean_ = false;
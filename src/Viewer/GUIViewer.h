@@ -39,6 +39,8 @@ private:
 	SurfaceMesh mesh_;
 	SurfaceMesh sliced_mesh_;
 	MeshMarker marker_;
+	// Previous hyperbolic solutions, to start again from them after a marker edit.
+	HyperbolicSolutionCache hyperbolic_cache_;
 
 	std::vector<OpenMesh::VertexHandle> cone_vts_;
 